@@ -1,7 +1,119 @@
 #include "arena.h"
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+// windows.h defines CreateWindow as a macro, which clashes with ours
+#undef CreateWindow
+#else
+#include <sys/mman.h>
+#endif
+
+#if ARENA_INSTRUMENT
+#include <atomic>
+#endif
+
+// os virtual memory layer
+//
+void* OsReserve(u64 size)
+{
+#if defined(_WIN32)
+  return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+  void* ptr = mmap(
+    NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return ptr == MAP_FAILED ? NULL : ptr;
+#endif
+}
+
+bool OsCommit(void* ptr, u64 size)
+{
+#if defined(_WIN32)
+  return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+  return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+void OsDecommit(void* ptr, u64 size)
+{
+#if defined(_WIN32)
+  VirtualFree(ptr, size, MEM_DECOMMIT);
+#else
+  madvise(ptr, size, MADV_DONTNEED);
+  mprotect(ptr, size, PROT_NONE);
+#endif
+}
+
+void OsRelease(void* ptr, u64 size)
+{
+#if defined(_WIN32)
+  (void)size;
+  VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+  munmap(ptr, size);
+#endif
+}
+
+u64 g_arena_hugetlb_limit = ARENA_HUGETLB_LIMIT_DEFAULT;
+
+// tries hugetlbfs pages first for sizes up to g_arena_hugetlb_limit, which
+// need the whole range available in the preallocated pool and are committed
+// up front. otherwise reserves a 2MB aligned range and asks for transparent
+// huge pages. the mode that actually took effect is or'd into flags
+void* OsReserveHuge(u64 size, u32* flags)
+{
+#if defined(_WIN32)
+  // large pages need SeLockMemoryPrivilege and can't be committed lazily
+  return OsReserve(size);
+#else
+  if (size <= g_arena_hugetlb_limit)
+  {
+    void* ptr = mmap(NULL,
+                     size,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                     -1,
+                     0);
+    if (ptr != MAP_FAILED)
+    {
+      *flags |= ARENA_FLAG_HUGE_EXPLICIT;
+      return ptr;
+    }
+  }
+
+  u8* base = (u8*)OsReserve(size + ARENA_HUGE_PAGE_SIZE);
+  if (base == NULL)
+  {
+    return NULL;
+  }
+
+  // trim the slop so the range starts on a huge page boundary
+  u8* aligned = (u8*)ForwardAlign((u64)base, ARENA_HUGE_PAGE_SIZE);
+  u64 head = aligned - base;
+  if (head)
+  {
+    munmap(base, head);
+  }
+  u64 tail = ARENA_HUGE_PAGE_SIZE - head;
+  if (tail)
+  {
+    munmap(aligned + size, tail);
+  }
+
+  if (madvise(aligned, size, MADV_HUGEPAGE) == 0)
+  {
+    *flags |= ARENA_FLAG_HUGE_TRANSPARENT;
+  }
+  return aligned;
+#endif
+}
+
 bool IsPowerOfTwo(u64 x)
 {
   return (x & (x - 1)) == 0;
@@ -27,11 +139,257 @@ Arena ArenaInit(void* backing, u64 backing_size)
     .memory = (u8*)backing,
     .offset = 0,
     .size = backing_size,
+    .committed = backing_size,
+    .commit_granularity = ARENA_COMMIT_GRANULARITY,
+    .flags = ARENA_FLAG_NONE,
+  };
+  return arena;
+}
+
+// reserves address space only, physical pages get committed in
+// commit_granularity chunks as pushes walk past the committed range
+Arena ArenaReserve(u64 reserve_size, u32 flags)
+{
+  flags &= ~(ARENA_FLAG_HUGE_EXPLICIT | ARENA_FLAG_HUGE_TRANSPARENT);
+
+  void* memory = NULL;
+  u64 granularity = ARENA_COMMIT_GRANULARITY;
+  u64 committed = 0;
+  if (flags & ARENA_FLAG_HUGE_PAGES)
+  {
+    reserve_size = ForwardAlign(reserve_size, ARENA_HUGE_PAGE_SIZE);
+    memory = OsReserveHuge(reserve_size, &flags);
+    if (flags & ARENA_FLAG_HUGE_EXPLICIT)
+    {
+      // hugetlb mappings are backed up front, nothing to commit or decommit
+      committed = reserve_size;
+      flags &= ~ARENA_FLAG_DECOMMIT;
+    }
+    if (flags & ARENA_FLAG_HUGE_TRANSPARENT)
+    {
+      // commit whole huge pages so the kernel can back them with one entry
+      granularity = ARENA_HUGE_PAGE_SIZE;
+    }
+  }
+  else
+  {
+    reserve_size = ForwardAlign(reserve_size, ARENA_COMMIT_GRANULARITY);
+    memory = OsReserve(reserve_size);
+  }
+  if (memory == NULL)
+  {
+    fprintf(stderr, "[ERROR]: could not reserve %llu bytes for arena\n",
+            (unsigned long long)reserve_size);
+    exit(-1);
+  }
+
+  Arena arena = {
+    .memory = (u8*)memory,
+    .offset = 0,
+    .size = reserve_size,
+    .committed = committed,
+    .commit_granularity = granularity,
+    .flags = flags | ARENA_FLAG_VIRTUAL,
   };
   return arena;
 }
 
-void* ArenaPushAlign(Arena* arena, u64 push_size, u64 alignment)
+const char* ArenaPageMode(Arena* arena)
+{
+  if (arena->flags & ARENA_FLAG_HUGE_EXPLICIT)
+  {
+    return "hugetlb 2MB pages";
+  }
+  if (arena->flags & ARENA_FLAG_HUGE_TRANSPARENT)
+  {
+    return "transparent 2MB pages";
+  }
+  return "4KB pages";
+}
+
+void ArenaRelease(Arena* arena)
+{
+  if (arena->flags & ARENA_FLAG_VIRTUAL)
+  {
+    OsRelease(arena->memory, arena->size);
+  }
+  *arena = {};
+}
+
+static void ArenaCommit(Arena* arena, u64 end)
+{
+  u64 commit_end = ForwardAlign(end, arena->commit_granularity);
+  if (commit_end > arena->size)
+  {
+    commit_end = arena->size;
+  }
+
+  if (!OsCommit(arena->memory + arena->committed,
+                commit_end - arena->committed))
+  {
+    fprintf(stderr, "[ERROR]: could not commit arena pages up to %llu bytes\n",
+            (unsigned long long)commit_end);
+    exit(-1);
+  }
+  arena->committed = commit_end;
+}
+
+#if ARENA_INSTRUMENT
+static ArenaStats g_arena_stats[ARENA_MAX_STATS];
+static ArenaSite g_arena_sites[ARENA_MAX_SITES];
+static u32 g_arena_stats_count;
+static std::atomic_flag g_arena_stats_lock = ATOMIC_FLAG_INIT;
+
+static void ArenaStatsLock()
+{
+  while (g_arena_stats_lock.test_and_set(std::memory_order_acquire))
+  {
+  }
+}
+
+static void ArenaStatsUnlock()
+{
+  g_arena_stats_lock.clear(std::memory_order_release);
+}
+
+static ArenaStats* ArenaFindStats(const char* name)
+{
+  for (u32 i = 0; i < g_arena_stats_count; i++)
+  {
+    if (strcmp(g_arena_stats[i].name, name) == 0)
+    {
+      return &g_arena_stats[i];
+    }
+  }
+  assert(g_arena_stats_count < ARENA_MAX_STATS);
+  ArenaStats* stats = &g_arena_stats[g_arena_stats_count++];
+  stats->name = name;
+  return stats;
+}
+
+void ArenaSetName(Arena* arena, const char* name)
+{
+  ArenaStatsLock();
+  arena->stats = ArenaFindStats(name);
+  ArenaStatsUnlock();
+}
+
+static void ArenaRecord(Arena* arena, u64 push_size, std::source_location site)
+{
+  ArenaStatsLock();
+  if (arena->stats == NULL)
+  {
+    arena->stats = ArenaFindStats("unnamed");
+  }
+
+  ArenaStats* stats = arena->stats;
+  stats->alloc_count += 1;
+  stats->alloc_bytes += push_size;
+  if (arena->offset > stats->peak_offset)
+  {
+    stats->peak_offset = arena->offset;
+  }
+  if (arena->committed > stats->peak_committed)
+  {
+    stats->peak_committed = arena->committed;
+  }
+
+  // file name literals are unique per translation unit, so pointer equality
+  // is enough to tell call sites apart
+  u64 hash = ((u64)site.file_name() >> 4) * 31 + site.line() * 2654435761u;
+  for (u32 probe = 0; probe < ARENA_MAX_SITES; probe++)
+  {
+    ArenaSite* slot = &g_arena_sites[(hash + probe) & (ARENA_MAX_SITES - 1)];
+    if (slot->file == NULL)
+    {
+      slot->file = site.file_name();
+      slot->line = site.line();
+      slot->stats = stats;
+    }
+    if (slot->file == site.file_name() && slot->line == site.line() &&
+        slot->stats == stats)
+    {
+      slot->alloc_count += 1;
+      slot->alloc_bytes += push_size;
+      if (push_size > slot->largest)
+      {
+        slot->largest = push_size;
+      }
+      break;
+    }
+  }
+  ArenaStatsUnlock();
+}
+
+static const char* ArenaBaseName(const char* path)
+{
+  const char* base = path;
+  for (const char* c = path; *c; c++)
+  {
+    if (*c == '/' || *c == '\\')
+    {
+      base = c + 1;
+    }
+  }
+  return base;
+}
+
+static int ArenaCompareSites(const void* a, const void* b)
+{
+  u64 bytes_a = (*(ArenaSite**)a)->alloc_bytes;
+  u64 bytes_b = (*(ArenaSite**)b)->alloc_bytes;
+  return bytes_a < bytes_b ? 1 : (bytes_a > bytes_b ? -1 : 0);
+}
+
+void ArenaDumpStats(FILE* out)
+{
+  ArenaStatsLock();
+  fprintf(out, "arena stats:\n");
+  for (u32 i = 0; i < g_arena_stats_count; i++)
+  {
+    ArenaStats* stats = &g_arena_stats[i];
+    fprintf(out,
+            "  %-12s peak %10.3f MiB  committed %10.3f MiB  %8llu allocs  "
+            "%10.3f MiB total\n",
+            stats->name,
+            stats->peak_offset / (1024.0 * 1024.0),
+            stats->peak_committed / (1024.0 * 1024.0),
+            (unsigned long long)stats->alloc_count,
+            stats->alloc_bytes / (1024.0 * 1024.0));
+  }
+
+  ArenaSite* sites[ARENA_MAX_SITES];
+  u32 site_count = 0;
+  for (u32 i = 0; i < ARENA_MAX_SITES; i++)
+  {
+    if (g_arena_sites[i].file != NULL)
+    {
+      sites[site_count++] = &g_arena_sites[i];
+    }
+  }
+  qsort(sites, site_count, sizeof(ArenaSite*), ArenaCompareSites);
+
+  fprintf(out, "call sites:\n");
+  for (u32 i = 0; i < site_count; i++)
+  {
+    fprintf(out,
+            "  %s:%u [%s] %llu allocs  %.3f MiB total  %.3f MiB largest\n",
+            ArenaBaseName(sites[i]->file),
+            sites[i]->line,
+            sites[i]->stats->name,
+            (unsigned long long)sites[i]->alloc_count,
+            sites[i]->alloc_bytes / (1024.0 * 1024.0),
+            sites[i]->largest / (1024.0 * 1024.0));
+  }
+  ArenaStatsUnlock();
+}
+#endif
+
+// caller is expected to overwrite the whole block, memory left over from a
+// previous reset is handed back as is
+void* ArenaPushAlignNoZero(Arena* arena,
+                           u64 push_size,
+                           u64 alignment ARENA_SITE_PARAM)
 {
   u64 current_address = (u64)arena->memory + arena->offset;
 
@@ -39,20 +397,125 @@ void* ArenaPushAlign(Arena* arena, u64 push_size, u64 alignment)
 
   offset -= (u64)arena->memory;
 
-  assert(arena->offset + push_size <= arena->size);
+  if (offset + push_size > arena->size)
+  {
+    fprintf(stderr, "[ERROR]: arena out of space, %llu byte push at %llu of "
+            "%llu bytes\n",
+            (unsigned long long)push_size,
+            (unsigned long long)offset,
+            (unsigned long long)arena->size);
+    exit(-1);
+  }
+
+  if (offset + push_size > arena->committed)
+  {
+    ArenaCommit(arena, offset + push_size);
+  }
 
   void* ptr = &arena->memory[offset];
   arena->offset = offset + push_size;
+#if ARENA_INSTRUMENT
+  ArenaRecord(arena, push_size, site);
+#endif
+  return ptr;
+}
+
+void* ArenaPushAlign(Arena* arena,
+                     u64 push_size,
+                     u64 alignment ARENA_SITE_PARAM)
+{
+  void* ptr = ArenaPushAlignNoZero(arena, push_size, alignment ARENA_SITE_ARG);
   memset(ptr, 0, push_size);
   return ptr;
 }
 
-void* ArenaPush(Arena* arena, u64 push_size)
+void* ArenaPushNoZero(Arena* arena, u64 push_size ARENA_SITE_PARAM)
 {
-  return ArenaPushAlign(arena, push_size, DEFAULT_ALIGNMENT);
+  return ArenaPushAlignNoZero(
+    arena, push_size, DEFAULT_ALIGNMENT ARENA_SITE_ARG);
+}
+
+void* ArenaPush(Arena* arena, u64 push_size ARENA_SITE_PARAM)
+{
+  return ArenaPushAlign(arena, push_size, DEFAULT_ALIGNMENT ARENA_SITE_ARG);
 }
 
 void ArenaReset(Arena* arena)
 {
   arena->offset = 0;
+
+  // keep the first chunk around so small users don't fault every reset
+  if ((arena->flags & ARENA_FLAG_DECOMMIT) &&
+      arena->committed > arena->commit_granularity)
+  {
+    OsDecommit(arena->memory + arena->commit_granularity,
+               arena->committed - arena->commit_granularity);
+    arena->committed = arena->commit_granularity;
+  }
+}
+
+ArenaTemp ArenaTempBegin(Arena* arena)
+{
+  ArenaTemp temp = {
+    .arena = arena,
+    .offset = arena->offset,
+  };
+  return temp;
+}
+
+void ArenaTempEnd(ArenaTemp temp)
+{
+  assert(temp.offset <= temp.arena->offset);
+  temp.arena->offset = temp.offset;
+}
+
+u32 g_scratch_arena_flags = ARENA_FLAG_VIRTUAL;
+static thread_local Arena t_scratch_arenas[SCRATCH_ARENA_COUNT];
+
+// hands out a checkpoint on a thread local scratch arena that isn't one of
+// the conflicts, so a function can take a scratch arena for its own temporary
+// memory while writing results into an arena its caller got the same way
+ArenaTemp GetScratch(Arena** conflicts, u32 conflict_count)
+{
+  for (u32 i = 0; i < SCRATCH_ARENA_COUNT; i++)
+  {
+    Arena* scratch = &t_scratch_arenas[i];
+
+    bool conflicting = false;
+    for (u32 j = 0; j < conflict_count; j++)
+    {
+      if (conflicts[j] == scratch)
+      {
+        conflicting = true;
+        break;
+      }
+    }
+    if (conflicting)
+    {
+      continue;
+    }
+
+    if (scratch->memory == NULL)
+    {
+      *scratch = ArenaReserve(SCRATCH_ARENA_RESERVE, g_scratch_arena_flags);
+      ArenaSetName(scratch, "scratch");
+    }
+    return ArenaTempBegin(scratch);
+  }
+
+  assert(!"every scratch arena conflicts, bump SCRATCH_ARENA_COUNT");
+  return {};
+}
+
+// thread scratch arenas outlive nothing but their thread, call this before a
+// worker exits so their address space doesn't leak
+void ReleaseThreadScratch()
+{
+  for (u32 i = 0; i < SCRATCH_ARENA_COUNT; i++)
+  {
+    if (t_scratch_arenas[i].memory != NULL)
+    {
+      ArenaRelease(&t_scratch_arenas[i]);
+    }
+  }
 }
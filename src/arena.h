@@ -1,19 +1,156 @@
 #pragma once
 
 #include "types.h"
+#include <stdio.h>
+
+// build with ARENA_INSTRUMENT=1 to track peak usage per arena and bytes per
+// call site, every hook below compiles away when it is off
+#ifndef ARENA_INSTRUMENT
+#define ARENA_INSTRUMENT 0
+#endif
+
+#if ARENA_INSTRUMENT
+#include <source_location>
+#define ARENA_SITE_DECL                                                        \
+  , std::source_location site = std::source_location::current()
+#define ARENA_SITE_PARAM , std::source_location site
+#define ARENA_SITE_ARG , site
+#else
+#define ARENA_SITE_DECL
+#define ARENA_SITE_PARAM
+#define ARENA_SITE_ARG
+#endif
+
+enum ArenaFlags
+{
+  ARENA_FLAG_NONE = 0,
+  // reserve address space up front and commit pages as offset grows
+  ARENA_FLAG_VIRTUAL = 1 << 0,
+  // hand committed pages back to the os on reset (virtual arenas only)
+  ARENA_FLAG_DECOMMIT = 1 << 1,
+  // ask for 2MB pages, hugetlbfs if the reservation is within
+  // g_arena_hugetlb_limit and the pool can back all of it, otherwise
+  // transparent huge pages
+  ARENA_FLAG_HUGE_PAGES = 1 << 2,
+  // set by ArenaReserve to report which huge page mode took effect
+  ARENA_FLAG_HUGE_EXPLICIT = 1 << 3,
+  ARENA_FLAG_HUGE_TRANSPARENT = 1 << 4,
+};
 
 struct Arena
 {
-    u8 *memory;
-    u64 offset;
-    u64 size;
+  u8 *memory;
+  u64 offset;
+  u64 size;
+  u64 committed;
+  u64 commit_granularity;
+  u32 flags;
+#if ARENA_INSTRUMENT
+  struct ArenaStats *stats;
+#endif
+};
+
+#if ARENA_INSTRUMENT
+// shared by every arena with the same name, e.g. all thread scratch arenas
+struct ArenaStats
+{
+  const char *name;
+  u64 peak_offset;
+  u64 peak_committed;
+  u64 alloc_count;
+  u64 alloc_bytes;
+};
+
+struct ArenaSite
+{
+  const char *file;
+  u32 line;
+  ArenaStats *stats;
+  u64 alloc_count;
+  u64 alloc_bytes;
+  u64 largest;
+};
+
+#define ARENA_MAX_STATS 32
+#define ARENA_MAX_SITES 1024
+#endif
+
+// checkpoint of an arena's offset, ending it frees everything pushed since
+struct ArenaTemp
+{
+  Arena *arena;
+  u64 offset;
 };
 
 #define DEFAULT_ALIGNMENT 16
+#define ARENA_COMMIT_GRANULARITY ((u64)64 * 1024)
+#define ARENA_HUGE_PAGE_SIZE ((u64)2 * 1024 * 1024)
+
+// per-thread scratch arenas, two is enough as long as callers pass in the
+// arenas they were handed so the pool can pick one that doesn't alias them
+#define SCRATCH_ARENA_COUNT 2
+#define SCRATCH_ARENA_RESERVE ((u64)1024 * 1024 * 1024)
+
+// flags new thread scratch arenas get reserved with
+extern u32 g_scratch_arena_flags;
+
+// largest reservation that tries hugetlbfs pages. they are committed up
+// front, so bigger arenas go straight to transparent huge pages instead of
+// draining the preallocated pool
+#define ARENA_HUGETLB_LIMIT_DEFAULT ((u64)64 * 1024 * 1024)
+extern u64 g_arena_hugetlb_limit;
+
+// os virtual memory, sizes and addresses are multiples of the page size
+void *OsReserve(u64 size);
+bool OsCommit(void *ptr, u64 size);
+void OsDecommit(void *ptr, u64 size);
+void OsRelease(void *ptr, u64 size);
+void *OsReserveHuge(u64 size, u32 *flags);
 
 bool IsPowerOfTwo(u64 x);
 u64 ForwardAlign(u64 ptr, u64 alignment);
 Arena ArenaInit(void *backing, u64 backing_size);
-void *ArenaPushAligned(Arena *arena, u64 push_size, u64 alignment);
-void *ArenaPush(Arena *arena, u64 push_size);
+Arena ArenaReserve(u64 reserve_size, u32 flags);
+const char *ArenaPageMode(Arena *arena);
+void ArenaRelease(Arena *arena);
+void *ArenaPushAlign(Arena *arena,
+                     u64 push_size,
+                     u64 alignment ARENA_SITE_DECL);
+void *ArenaPush(Arena *arena, u64 push_size ARENA_SITE_DECL);
+void *ArenaPushAlignNoZero(Arena *arena,
+                           u64 push_size,
+                           u64 alignment ARENA_SITE_DECL);
+void *ArenaPushNoZero(Arena *arena, u64 push_size ARENA_SITE_DECL);
 void ArenaReset(Arena *arena);
+ArenaTemp ArenaTempBegin(Arena *arena);
+void ArenaTempEnd(ArenaTemp temp);
+ArenaTemp GetScratch(Arena **conflicts, u32 conflict_count);
+#define ReleaseScratch(temp) ArenaTempEnd(temp)
+void ReleaseThreadScratch();
+
+#if ARENA_INSTRUMENT
+void ArenaSetName(Arena *arena, const char *name);
+void ArenaDumpStats(FILE *out);
+#else
+inline void ArenaSetName(Arena *, const char *) {}
+inline void ArenaDumpStats(FILE *) {}
+#endif
+
+// typed helpers, alignment never drops below DEFAULT_ALIGNMENT
+template <typename T>
+inline T *PushArray(Arena *arena, u64 count ARENA_SITE_DECL)
+{
+  u64 alignment =
+    alignof(T) > DEFAULT_ALIGNMENT ? alignof(T) : DEFAULT_ALIGNMENT;
+  return (T *)ArenaPushAlign(
+    arena, sizeof(T) * count, alignment ARENA_SITE_ARG);
+}
+
+template <typename T>
+inline T *PushArrayNoZero(Arena *arena, u64 count ARENA_SITE_DECL)
+{
+  u64 alignment =
+    alignof(T) > DEFAULT_ALIGNMENT ? alignof(T) : DEFAULT_ALIGNMENT;
+  return (T *)ArenaPushAlignNoZero(
+    arena, sizeof(T) * count, alignment ARENA_SITE_ARG);
+}
@@ -0,0 +1,199 @@
+#include "arena.cpp"
+#include <chrono>
+
+// arena microbenchmarks, builds without SDL or vulkan
+//     arena_bench [vertex_count] [index_count] [runs]
+//     fills a mesh sized vertex and index set the way extract_mesh does,
+//     once with zeroing pushes and once without. the arena is warmed up
+//     first so page faults don't drown out the memset.
+//     then extracts the same mesh into fresh 4KB and huge page arenas and
+//     walks the vertices in index order, which is where the TLB misses are
+//
+struct BenchVertex
+{
+  float x, y, z;
+  float nx, ny, nz;
+  float u, v;
+};
+
+struct BenchMesh
+{
+  BenchVertex *vertices;
+  u32 *indices;
+};
+
+static double NowMs()
+{
+  using namespace std::chrono;
+  return duration<double, std::milli>(
+           steady_clock::now().time_since_epoch())
+    .count();
+}
+
+// every byte gets written, same as an accessor unpack into fresh arrays
+static void FillMesh(BenchMesh *mesh, u32 vertex_count, u32 index_count)
+{
+  for (u32 i = 0; i < vertex_count; i++)
+  {
+    float f = (float)i;
+    mesh->vertices[i] = {
+      f, f * 0.5f, f * 0.25f, 0.0f, 1.0f, 0.0f, f * 0.125f, f * 0.0625f,
+    };
+  }
+  for (u32 i = 0; i < index_count; i++)
+  {
+    mesh->indices[i] = (i * 2654435761u) % vertex_count;
+  }
+}
+
+static u64 ChecksumMesh(BenchMesh *mesh, u32 vertex_count, u32 index_count)
+{
+  u64 sum = 0;
+  for (u32 i = 0; i < vertex_count; i += 4096)
+  {
+    sum += (u64)mesh->vertices[i].x;
+  }
+  for (u32 i = 0; i < index_count; i += 4096)
+  {
+    sum += mesh->indices[i];
+  }
+  return sum;
+}
+
+static double TimeFill(Arena *arena,
+                       bool zero,
+                       u32 vertex_count,
+                       u32 index_count,
+                       u32 runs,
+                       u64 *checksum)
+{
+  double best = 1e30;
+  for (u32 run = 0; run < runs; run++)
+  {
+    ArenaReset(arena);
+    double start = NowMs();
+
+    BenchMesh mesh;
+    if (zero)
+    {
+      mesh.vertices = PushArray<BenchVertex>(arena, vertex_count);
+      mesh.indices = PushArray<u32>(arena, index_count);
+    }
+    else
+    {
+      mesh.vertices = PushArrayNoZero<BenchVertex>(arena, vertex_count);
+      mesh.indices = PushArrayNoZero<u32>(arena, index_count);
+    }
+    FillMesh(&mesh, vertex_count, index_count);
+
+    double elapsed = NowMs() - start;
+    *checksum += ChecksumMesh(&mesh, vertex_count, index_count);
+    if (elapsed < best)
+    {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+// reads every vertex the index buffer references, scattered across the
+// whole vertex array like a vertex cache pass or bounds walk
+static float GatherMesh(BenchMesh *mesh, u32 index_count)
+{
+  float sum = 0.0f;
+  for (u32 i = 0; i < index_count; i++)
+  {
+    BenchVertex *vertex = &mesh->vertices[mesh->indices[i]];
+    sum += vertex->x + vertex->ny + vertex->u;
+  }
+  return sum;
+}
+
+// every run reserves a new arena so commit and page fault cost is included
+static double TimeExtract(u32 flags,
+                          u32 vertex_count,
+                          u32 index_count,
+                          u32 runs,
+                          const char **page_mode,
+                          u64 *checksum)
+{
+  u64 bytes = (u64)vertex_count * sizeof(BenchVertex) +
+              (u64)index_count * sizeof(u32) + 2 * DEFAULT_ALIGNMENT;
+  double best = 1e30;
+  for (u32 run = 0; run < runs; run++)
+  {
+    Arena arena = ArenaReserve(bytes, flags);
+    *page_mode = ArenaPageMode(&arena);
+    double start = NowMs();
+
+    BenchMesh mesh = {
+      .vertices = PushArrayNoZero<BenchVertex>(&arena, vertex_count),
+      .indices = PushArrayNoZero<u32>(&arena, index_count),
+    };
+    FillMesh(&mesh, vertex_count, index_count);
+    float sum = GatherMesh(&mesh, index_count);
+
+    double elapsed = NowMs() - start;
+    *checksum += (u64)sum;
+    if (elapsed < best)
+    {
+      best = elapsed;
+    }
+    ArenaRelease(&arena);
+  }
+  return best;
+}
+
+int main(int argc, char **argv)
+{
+  u32 vertex_count = argc > 1 ? (u32)atoi(argv[1]) : 2 * 1024 * 1024;
+  u32 index_count = argc > 2 ? (u32)atoi(argv[2]) : 6 * 1024 * 1024;
+  u32 runs = argc > 3 ? (u32)atoi(argv[3]) : 10;
+  if (vertex_count == 0 || runs == 0)
+  {
+    fprintf(stderr, "usage: %s [vertex_count] [index_count] [runs]\n", argv[0]);
+    return -1;
+  }
+
+  u64 bytes = (u64)vertex_count * sizeof(BenchVertex) +
+              (u64)index_count * sizeof(u32) + 2 * DEFAULT_ALIGNMENT;
+  Arena arena = ArenaReserve(bytes, ARENA_FLAG_VIRTUAL);
+
+  // touch every page once so both variants run on committed memory
+  memset(ArenaPushNoZero(&arena, bytes), 0xff, bytes);
+
+  u64 checksum = 0;
+  double zeroed =
+    TimeFill(&arena, true, vertex_count, index_count, runs, &checksum);
+  double no_zero =
+    TimeFill(&arena, false, vertex_count, index_count, runs, &checksum);
+
+  printf("%u vertices, %u indices, %.1f MiB, best of %u\n",
+         vertex_count,
+         index_count,
+         bytes / (1024.0 * 1024.0),
+         runs);
+  printf("  PushArray        %8.2f ms\n", zeroed);
+  printf("  PushArrayNoZero  %8.2f ms\n", no_zero);
+
+  ArenaRelease(&arena);
+
+  const char *small_mode = NULL;
+  const char *huge_mode = NULL;
+  double small_pages = TimeExtract(ARENA_FLAG_VIRTUAL,
+                                   vertex_count,
+                                   index_count,
+                                   runs,
+                                   &small_mode,
+                                   &checksum);
+  double huge_pages = TimeExtract(ARENA_FLAG_VIRTUAL | ARENA_FLAG_HUGE_PAGES,
+                                  vertex_count,
+                                  index_count,
+                                  runs,
+                                  &huge_mode,
+                                  &checksum);
+  printf("  extract + gather on %-22s %8.2f ms\n", small_mode, small_pages);
+  printf("  extract + gather on %-22s %8.2f ms\n", huge_mode, huge_pages);
+  printf("  (checksum %llu)\n", (unsigned long long)checksum);
+  return 0;
+}
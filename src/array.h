@@ -0,0 +1,127 @@
+#pragma once
+
+#include "arena.h"
+#include <assert.h>
+#include <string.h>
+
+// growable array living in an arena. when the array is the most recent push it
+// grows in place, otherwise it moves to a fresh block twice the size and the
+// old block is left for the arena to reclaim on reset
+template <typename T>
+struct Array
+{
+  Arena *arena;
+  T *data;
+  u32 count;
+  u32 capacity;
+
+  T &operator[](u32 index)
+  {
+    assert(index < count);
+    return data[index];
+  }
+
+  const T &operator[](u32 index) const
+  {
+    assert(index < count);
+    return data[index];
+  }
+};
+
+template <typename T>
+Array<T> ArrayInit(Arena *arena, u32 capacity)
+{
+  Array<T> array = {
+    .arena = arena,
+    .data = capacity ? PushArrayNoZero<T>(arena, capacity) : NULL,
+    .count = 0,
+    .capacity = capacity,
+  };
+  return array;
+}
+
+template <typename T>
+void ArrayReserve(Array<T> *array, u32 capacity)
+{
+  if (capacity <= array->capacity)
+  {
+    return;
+  }
+
+  Arena *arena = array->arena;
+  u8 *end = (u8 *)(array->data + array->capacity);
+  if (array->data != NULL && end == arena->memory + arena->offset)
+  {
+    // still on top of the arena, just bump it
+    ArenaPushAlignNoZero(arena, sizeof(T) * (capacity - array->capacity), 1);
+  }
+  else
+  {
+    T *data = PushArrayNoZero<T>(arena, capacity);
+    if (array->count)
+    {
+      memcpy((void *)data, array->data, sizeof(T) * array->count);
+    }
+    array->data = data;
+  }
+  array->capacity = capacity;
+}
+
+template <typename T>
+T *ArrayPush(Array<T> *array, const T &value)
+{
+  if (array->count == array->capacity)
+  {
+    ArrayReserve(array, array->capacity ? array->capacity * 2 : 16);
+  }
+  T *slot = &array->data[array->count++];
+  *slot = value;
+  return slot;
+}
+
+// appends a zeroed element for the caller to fill in
+template <typename T>
+T *ArrayPush(Array<T> *array)
+{
+  T value = {};
+  return ArrayPush(array, value);
+}
+
+// appends count elements in one copy, growing at most once
+template <typename T>
+T *ArrayAppend(Array<T> *array, const T *values, u32 count)
+{
+  if (array->count + count > array->capacity)
+  {
+    u32 capacity = array->capacity ? array->capacity * 2 : 16;
+    while (capacity < array->count + count)
+    {
+      capacity *= 2;
+    }
+    ArrayReserve(array, capacity);
+  }
+  T *slots = array->data + array->count;
+  if (count)
+  {
+    memcpy((void *)slots, values, sizeof(T) * count);
+  }
+  array->count += count;
+  return slots;
+}
+
+// removes count elements starting at first, later elements slide down
+template <typename T>
+void ArrayRemoveRange(Array<T> *array, u32 first, u32 count)
+{
+  assert(first + count <= array->count);
+  memmove((void *)(array->data + first),
+          array->data + first + count,
+          sizeof(T) * (array->count - first - count));
+  array->count -= count;
+}
+
+template <typename T>
+void ArrayClear(Array<T> *array)
+{
+  array->count = 0;
+}
@@ -0,0 +1,157 @@
+#include "headers.h"
+
+#include "arena.cpp"
+#include "concurrent_arena.cpp"
+#include "jobs.cpp"
+#include "mesh_cache.cpp"
+#include "mesh_codec.cpp"
+#include "mesh.cpp"
+#include "mesh_process.cpp"
+#include "meshlet.cpp"
+#include "simplify.cpp"
+
+int g_debug_enabled = 0;
+
+// offline asset cooker
+//     assetcook [-d] [-rawcache] [-weld-epsilon <e>] <directory>
+//     parses every .glb in the directory on the worker pool, runs the
+//     processing stages on each primitive and writes the cooked .mcache next
+//     to the source, which the runtime loads without touching cgltf.
+//     -rawcache skips the codec so the runtime can map the data in place
+//
+struct CookJob
+{
+  MeshLoadJob load;
+  u32 primitive_count;
+  u64 vertices_before;
+  u64 vertices_after;
+  u64 indices;
+  // indices of the coarser levels and the most levels any primitive got
+  u64 lod_indices;
+  u32 lod_count;
+  u32 meshlet_count;
+  // uncooked vertex and index bytes against the cache file
+  u64 raw_bytes;
+  u64 cache_bytes;
+  // summed over primitives, weighted by triangle count
+  double acmr_before;
+  double acmr_after;
+  double milliseconds;
+};
+
+static void CookFile(void *user, u32 index)
+{
+  CookJob *job = &((CookJob *)user)[index];
+  u64 start = SDL_GetPerformanceCounter();
+
+  InitMeshLoadJob(&job->load);
+  ParseMeshFile(&job->load);
+
+  for (u32 i = 0; i < job->load.primitives.count; i++)
+  {
+    RawMesh *mesh = &job->load.primitives[i];
+    double triangles = mesh->index_count / 3;
+    job->vertices_before += mesh->vertex_count;
+    job->acmr_before +=
+      AnalyzeVertexCache(mesh, VERTEX_CACHE_SIZE).acmr * triangles;
+    ProcessMesh(mesh, &job->load.arena, MESH_PROCESS_ALL);
+    // cache figures are for the full detail level
+    RawMesh lod = RawMeshLod(mesh, 0);
+    job->acmr_after +=
+      AnalyzeVertexCache(&lod, VERTEX_CACHE_SIZE).acmr * triangles;
+    job->vertices_after += mesh->vertex_count;
+    job->indices += lod.index_count;
+    job->lod_indices += mesh->index_count - lod.index_count;
+    job->lod_count = SDL_max(job->lod_count, mesh->lod_count);
+    job->raw_bytes += sizeof(Vertex) * (u64)mesh->vertex_count +
+                      sizeof(u32) * (u64)mesh->index_count;
+  }
+  job->primitive_count = job->load.primitives.count;
+  BuildMeshFileMeshlets(&job->load);
+  job->meshlet_count = job->load.meshlets.count;
+
+  job->cache_bytes = WriteMeshCache(&job->load, index, MESH_PROCESS_ALL);
+  ReleaseMeshLoadJob(&job->load);
+
+  job->milliseconds = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 /
+                      (double)SDL_GetPerformanceFrequency();
+}
+
+int main(int argc, char **argv)
+{
+  const char *directory = NULL;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-d") == 0)
+    {
+      g_debug_enabled = 1;
+    }
+    else if (strcmp(argv[i], "-rawcache") == 0)
+    {
+      g_mesh_cache_codec = MESH_CACHE_CODEC_RAW;
+    }
+    else if (strcmp(argv[i], "-weld-epsilon") == 0 && i + 1 < argc)
+    {
+      g_weld_epsilon = (float)atof(argv[++i]);
+    }
+    else
+    {
+      directory = argv[i];
+    }
+  }
+  if (directory == NULL)
+  {
+    fprintf(stderr,
+            "usage: assetcook [-d] [-rawcache] [-weld-epsilon <e>] "
+            "<directory>\n");
+    return 1;
+  }
+
+  int file_count = 0;
+  char **files = SDL_GlobDirectory(
+    directory, "*.glb", SDL_GLOB_CASEINSENSITIVE, &file_count);
+  if (files == NULL)
+  {
+    err("could not list %s: %s", directory, SDL_GetError());
+  }
+
+  Arena arena = ArenaReserve(megabytes(64), ARENA_FLAG_VIRTUAL);
+  CookJob *jobs = PushArray<CookJob>(&arena, file_count);
+  for (int i = 0; i < file_count; i++)
+  {
+    u64 length = strlen(directory) + strlen(files[i]) + 2;
+    char *path = PushArray<char>(&arena, length);
+    snprintf(path, length, "%s/%s", directory, files[i]);
+    jobs[i].load.path = path;
+  }
+  SDL_free(files);
+
+  u64 start = SDL_GetPerformanceCounter();
+  ParallelFor((u32)file_count, CookFile, jobs);
+  double total_ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 /
+                    (double)SDL_GetPerformanceFrequency();
+
+  for (int i = 0; i < file_count; i++)
+  {
+    CookJob *job = &jobs[i];
+    double triangles = job->indices ? job->indices / 3.0 : 1.0;
+    printf("%s: %u primitives, %llu -> %llu vertices, %llu indices, "
+           "%u lods (+%llu indices), %u meshlets, acmr %.3f -> %.3f, "
+           "%.1f -> %.1f KB on disk, %.2f ms\n",
+           job->load.path,
+           job->primitive_count,
+           (unsigned long long)job->vertices_before,
+           (unsigned long long)job->vertices_after,
+           (unsigned long long)job->indices,
+           job->lod_count,
+           (unsigned long long)job->lod_indices,
+           job->meshlet_count,
+           job->acmr_before / triangles,
+           job->acmr_after / triangles,
+           job->raw_bytes / 1024.0,
+           job->cache_bytes / 1024.0,
+           job->milliseconds);
+  }
+  printf("cooked %d files in %.2f ms\n", file_count, total_ms);
+  return 0;
+}
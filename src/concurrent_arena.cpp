@@ -0,0 +1,167 @@
+#include "concurrent_arena.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct ConcurrentArenaChunk
+{
+  ConcurrentArena *arena;
+  u64 generation;
+  u8 *cursor;
+  u8 *end;
+};
+
+static thread_local ConcurrentArenaChunk
+  t_concurrent_chunks[CONCURRENT_ARENA_THREAD_CHUNKS];
+static thread_local u32 t_concurrent_chunk_next;
+
+// only ever increases, a struct that is released and initialized again must
+// not hand out generations its old chunks were tagged with
+static std::atomic<u64> g_concurrent_arena_epoch;
+
+static u64 ConcurrentArenaNextGeneration()
+{
+  return g_concurrent_arena_epoch.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void ConcurrentArenaInit(ConcurrentArena* arena, u64 reserve_size)
+{
+  reserve_size = ForwardAlign(reserve_size, ARENA_COMMIT_GRANULARITY);
+
+  arena->memory = (u8*)OsReserve(reserve_size);
+  if (arena->memory == NULL)
+  {
+    fprintf(stderr, "[ERROR]: could not reserve %llu bytes for arena\n",
+            (unsigned long long)reserve_size);
+    exit(-1);
+  }
+  arena->size = reserve_size;
+  arena->offset.store(0);
+  arena->committed.store(0);
+  arena->generation.store(ConcurrentArenaNextGeneration());
+  arena->commit_lock.clear();
+}
+
+void ConcurrentArenaRelease(ConcurrentArena* arena)
+{
+  OsRelease(arena->memory, arena->size);
+  arena->memory = NULL;
+  arena->size = 0;
+  arena->offset.store(0);
+  arena->committed.store(0);
+  arena->generation.store(ConcurrentArenaNextGeneration());
+}
+
+// claims [offset, offset + size) with one fetch add, only threads that walk
+// past the committed range take the lock to commit more pages
+static u8* ConcurrentArenaClaim(ConcurrentArena* arena, u64 size)
+{
+  u64 offset = arena->offset.fetch_add(size, std::memory_order_relaxed);
+  u64 end = offset + size;
+  if (end > arena->size)
+  {
+    fprintf(stderr, "[ERROR]: concurrent arena out of space (%llu bytes)\n",
+            (unsigned long long)arena->size);
+    exit(-1);
+  }
+
+  if (end > arena->committed.load(std::memory_order_acquire))
+  {
+    while (arena->commit_lock.test_and_set(std::memory_order_acquire))
+    {
+    }
+    u64 committed = arena->committed.load(std::memory_order_relaxed);
+    if (end > committed)
+    {
+      u64 commit_end = ForwardAlign(end, ARENA_COMMIT_GRANULARITY);
+      if (commit_end > arena->size)
+      {
+        commit_end = arena->size;
+      }
+      if (!OsCommit(arena->memory + committed, commit_end - committed))
+      {
+        fprintf(stderr, "[ERROR]: could not commit concurrent arena pages\n");
+        exit(-1);
+      }
+      arena->committed.store(commit_end, std::memory_order_release);
+    }
+    arena->commit_lock.clear(std::memory_order_release);
+  }
+
+  return arena->memory + offset;
+}
+
+static ConcurrentArenaChunk* ConcurrentArenaThreadChunk(ConcurrentArena* arena)
+{
+  u64 generation = arena->generation.load(std::memory_order_relaxed);
+  for (u32 i = 0; i < CONCURRENT_ARENA_THREAD_CHUNKS; i++)
+  {
+    ConcurrentArenaChunk* chunk = &t_concurrent_chunks[i];
+    if (chunk->arena == arena)
+    {
+      if (chunk->generation != generation)
+      {
+        chunk->generation = generation;
+        chunk->cursor = NULL;
+        chunk->end = NULL;
+      }
+      return chunk;
+    }
+  }
+
+  ConcurrentArenaChunk* chunk =
+    &t_concurrent_chunks[t_concurrent_chunk_next++ %
+                         CONCURRENT_ARENA_THREAD_CHUNKS];
+  *chunk = {
+    .arena = arena,
+    .generation = generation,
+  };
+  return chunk;
+}
+
+void* ConcurrentArenaPushAlignNoZero(ConcurrentArena* arena,
+                                     u64 push_size,
+                                     u64 alignment)
+{
+  assert(IsPowerOfTwo(alignment));
+
+  // big pushes go straight to the shared offset so they don't waste chunks
+  if (push_size + alignment > CONCURRENT_ARENA_CHUNK_SIZE / 4)
+  {
+    u8* base = ConcurrentArenaClaim(arena, push_size + alignment - 1);
+    return (void*)ForwardAlign((u64)base, alignment);
+  }
+
+  ConcurrentArenaChunk* chunk = ConcurrentArenaThreadChunk(arena);
+  u64 start = ForwardAlign((u64)chunk->cursor, alignment);
+  if (chunk->cursor == NULL || start + push_size > (u64)chunk->end)
+  {
+    u8* base = ConcurrentArenaClaim(arena, CONCURRENT_ARENA_CHUNK_SIZE);
+    chunk->end = base + CONCURRENT_ARENA_CHUNK_SIZE;
+    start = ForwardAlign((u64)base, alignment);
+  }
+  chunk->cursor = (u8*)(start + push_size);
+  return (void*)start;
+}
+
+void* ConcurrentArenaPushAlign(ConcurrentArena* arena,
+                               u64 push_size,
+                               u64 alignment)
+{
+  void* ptr = ConcurrentArenaPushAlignNoZero(arena, push_size, alignment);
+  memset(ptr, 0, push_size);
+  return ptr;
+}
+
+void* ConcurrentArenaPush(ConcurrentArena* arena, u64 push_size)
+{
+  return ConcurrentArenaPushAlign(arena, push_size, DEFAULT_ALIGNMENT);
+}
+
+void ConcurrentArenaReset(ConcurrentArena* arena)
+{
+  arena->offset.store(0, std::memory_order_relaxed);
+  arena->generation.store(ConcurrentArenaNextGeneration(),
+                          std::memory_order_release);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "arena.h"
+#include <atomic>
+
+// arena that many threads can push into at once. every push is a fetch add on
+// offset, small pushes are carved out of a per-thread chunk so threads only
+// touch the shared offset once per CONCURRENT_ARENA_CHUNK_SIZE bytes.
+// reset and release must not race with pushes
+struct ConcurrentArena
+{
+  u8 *memory;
+  u64 size;
+  std::atomic<u64> offset;
+  std::atomic<u64> committed;
+  // taken from a global epoch on init, reset and release, so a chunk a
+  // thread cached never matches a later lifetime of the same struct
+  std::atomic<u64> generation;
+  std::atomic_flag commit_lock;
+};
+
+#define CONCURRENT_ARENA_CHUNK_SIZE ((u64)64 * 1024)
+#define CONCURRENT_ARENA_THREAD_CHUNKS 4
+
+void ConcurrentArenaInit(ConcurrentArena *arena, u64 reserve_size);
+void ConcurrentArenaRelease(ConcurrentArena *arena);
+void *ConcurrentArenaPushAlignNoZero(ConcurrentArena *arena,
+                                     u64 push_size,
+                                     u64 alignment);
+void *ConcurrentArenaPushAlign(ConcurrentArena *arena,
+                               u64 push_size,
+                               u64 alignment);
+void *ConcurrentArenaPush(ConcurrentArena *arena, u64 push_size);
+void ConcurrentArenaReset(ConcurrentArena *arena);
+
+template <typename T>
+inline T *PushArray(ConcurrentArena *arena, u64 count)
+{
+  u64 alignment =
+    alignof(T) > DEFAULT_ALIGNMENT ? alignof(T) : DEFAULT_ALIGNMENT;
+  return (T *)ConcurrentArenaPushAlign(arena, sizeof(T) * count, alignment);
+}
+
+template <typename T>
+inline T *PushArrayNoZero(ConcurrentArena *arena, u64 count)
+{
+  u64 alignment =
+    alignof(T) > DEFAULT_ALIGNMENT ? alignof(T) : DEFAULT_ALIGNMENT;
+  return (T *)ConcurrentArenaPushAlignNoZero(
+    arena, sizeof(T) * count, alignment);
+}
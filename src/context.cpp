@@ -52,37 +52,34 @@ void GetPhysicalDevice(State* state)
            "could not enumerate physical device count");
 
   // allocate to scratch space
-  VkPhysicalDevice* devices = (VkPhysicalDevice*)ArenaPush(
-    &state->scratch_arena, count * sizeof(VkPhysicalDevice));
+  ArenaTemp scratch = GetScratch(NULL, 0);
+  VkPhysicalDevice* devices =
+    PushArrayNoZero<VkPhysicalDevice>(scratch.arena, count);
 
   validate(
     vkEnumeratePhysicalDevices(state->context->instance, &count, devices),
     "could not enumerate physical devices");
 
-  // check for discrete physical device
-  for (u32 i = 0; i < count; i++)
-  {
-    VkPhysicalDeviceProperties properties;
-    vkGetPhysicalDeviceProperties(devices[i], &properties);
-    if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
-    {
-      state->context->gpu = devices[i];
-      debug("Chose device: %s", properties.deviceName);
-      return;
-    }
-  }
-  // check for integrated as second choice
-  for (u32 i = 0; i < count; i++)
+  // check for discrete physical device, integrated as second choice
+  VkPhysicalDeviceType preferred_types[] = {
+    VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU,
+    VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU,
+  };
+  for (u32 t = 0; t < 2 && state->context->gpu == VK_NULL_HANDLE; t++)
   {
-    VkPhysicalDeviceProperties properties;
-    vkGetPhysicalDeviceProperties(devices[i], &properties);
-    if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU)
+    for (u32 i = 0; i < count; i++)
     {
-      state->context->gpu = devices[i];
-      debug("Chose device: %s", properties.deviceName);
-      return;
+      VkPhysicalDeviceProperties properties;
+      vkGetPhysicalDeviceProperties(devices[i], &properties);
+      if (properties.deviceType == preferred_types[t])
+      {
+        state->context->gpu = devices[i];
+        debug("Chose device: %s", properties.deviceName);
+        break;
+      }
     }
   }
+  ReleaseScratch(scratch);
 }
 
 void GetDepthFormat(State* state)
@@ -126,35 +123,77 @@ void GetQueueIndex(State* state)
   u32 count;
   vkGetPhysicalDeviceQueueFamilyProperties(state->context->gpu, &count, NULL);
 
-  VkQueueFamilyProperties* families = (VkQueueFamilyProperties*)ArenaPush(
-    &state->scratch_arena, sizeof(VkQueueFamilyProperties) * count);
+  ArenaTemp scratch = GetScratch(NULL, 0);
+  VkQueueFamilyProperties* families =
+    PushArrayNoZero<VkQueueFamilyProperties>(scratch.arena, count);
 
   vkGetPhysicalDeviceQueueFamilyProperties(
     state->context->gpu, &count, families);
 
   // grapb the graphics queue
+  u32 graphics_index = UINT32_MAX;
   for (u32 i = 0; i < count; i++)
   {
     if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
     {
-      state->context->queue_index = i;
+      graphics_index = i;
       debug("Retrieved valid graphics queue index");
-      return;
+      break;
+    }
+  }
+  if (graphics_index == UINT32_MAX)
+  {
+    err("Failed to find graphics queue index");
+  }
+  state->context->queue_index = graphics_index;
+
+  // uploads prefer a transfer only family (the dma engine), then any non
+  // graphics family with transfer, then share the graphics queue
+  u32 transfer_index = graphics_index;
+  u32 best_extra_flags = UINT32_MAX;
+  for (u32 i = 0; i < count; i++)
+  {
+    VkQueueFlags flags = families[i].queueFlags;
+    if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT))
+    {
+      continue;
+    }
+    u32 extra_flags = (flags & VK_QUEUE_COMPUTE_BIT) ? 1 : 0;
+    if (extra_flags < best_extra_flags)
+    {
+      best_extra_flags = extra_flags;
+      transfer_index = i;
     }
   }
-  err("Failed to find graphics queue index");
+  state->context->transfer_queue_index = transfer_index;
+  debug("uploads on queue family %u (%s)",
+        transfer_index,
+        transfer_index == graphics_index ? "shared with graphics"
+                                         : "dedicated transfer");
+  ReleaseScratch(scratch);
 }
 
 void CreateLogicalDevice(State* state)
 {
   // create the actual queue
   float priorities = 1.0f;
-  VkDeviceQueueCreateInfo queue_info = {
-    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-    .queueFamilyIndex = state->context->queue_index,
-    .queueCount = 1,
-    .pQueuePriorities = &priorities,
+  VkDeviceQueueCreateInfo queue_infos[2] = {
+    {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = state->context->queue_index,
+      .queueCount = 1,
+      .pQueuePriorities = &priorities,
+    },
+    {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = state->context->transfer_queue_index,
+      .queueCount = 1,
+      .pQueuePriorities = &priorities,
+    },
   };
+  u32 queue_info_count =
+    state->context->transfer_queue_index == state->context->queue_index ? 1
+                                                                        : 2;
 
   // get device level extensions and features
   // core features
@@ -167,6 +206,7 @@ void CreateLogicalDevice(State* state)
     .descriptorIndexing = true,
     .descriptorBindingVariableDescriptorCount = true,
     .runtimeDescriptorArray = true,
+    .timelineSemaphore = true,
     .bufferDeviceAddress = true,
   };
 
@@ -182,8 +222,8 @@ void CreateLogicalDevice(State* state)
   VkDeviceCreateInfo device_info = {
     .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
     .pNext = &vk_13_features,
-    .queueCreateInfoCount = 1,
-    .pQueueCreateInfos = &queue_info,
+    .queueCreateInfoCount = queue_info_count,
+    .pQueueCreateInfos = queue_infos,
     .enabledExtensionCount = 1,
     .ppEnabledExtensionNames = extensions,
     .pEnabledFeatures = &core_features,
@@ -201,6 +241,10 @@ void CreateLogicalDevice(State* state)
                    state->context->queue_index,
                    0,
                    &state->context->queue);
+  vkGetDeviceQueue(state->context->device,
+                   state->context->transfer_queue_index,
+                   0,
+                   &state->context->transfer_queue);
   debug("Created logical device")
 }
 
@@ -294,6 +338,10 @@ void InitFrameContext(State* state)
                &buffer_info,
                &state->context->frame_context[i].command_buffer),
              "could not allocate command buffer");
+
+    state->context->frame_context[i].arena =
+      ArenaReserve(megabytes(256), ARENA_FLAG_VIRTUAL);
+    ArenaSetName(&state->context->frame_context[i].arena, "frame");
   }
 
   debug("created frame context");
@@ -317,8 +365,6 @@ void CreateVulkanContext(State* state)
   CreateWindow(state);
   // init frame synchronization
   InitFrameContext(state);
-  // reset scratch
-  ArenaReset(&state->scratch_arena);
   // notify
   debug("Created vulkan context successfully");
 }
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "arena.h"
+#include <assert.h>
+#include <string.h>
+
+// flat open addressing hash map living in an arena. linear probing over a
+// power of two table, removals leave tombstones and growing rehashes into a
+// fresh table twice the size
+enum HashSlotState : u8
+{
+  HASH_SLOT_EMPTY = 0,
+  HASH_SLOT_FULL = 1,
+  HASH_SLOT_TOMBSTONE = 2,
+};
+
+inline u64 HashMix(u64 x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+// eight bytes at a time with a multiply mix per word, fnv on the tail
+inline u64 HashBytes(const void *data, u64 size)
+{
+  const u8 *bytes = (const u8 *)data;
+  u64 hash = 0xcbf29ce484222325ull ^ (size * 0x9e3779b97f4a7c15ull);
+  u64 i = 0;
+  for (; i + 8 <= size; i += 8)
+  {
+    u64 word;
+    memcpy(&word, bytes + i, 8);
+    hash = (hash ^ (word * 0x9e3779b97f4a7c15ull)) * 0xff51afd7ed558ccdull;
+    hash ^= hash >> 29;
+  }
+  for (; i < size; i++)
+  {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+inline u64 HashKey(u64 key)
+{
+  return HashMix(key);
+}
+
+inline u64 HashKey(u32 key)
+{
+  return HashMix(key);
+}
+
+// fallback for plain structs, keys must not contain padding
+template <typename K>
+inline u64 HashKey(const K &key)
+{
+  return HashMix(HashBytes(&key, sizeof(K)));
+}
+
+template <typename K>
+inline bool HashKeyEquals(const K &a, const K &b)
+{
+  return memcmp(&a, &b, sizeof(K)) == 0;
+}
+
+template <typename K, typename V>
+struct HashMap
+{
+  Arena *arena;
+  K *keys;
+  V *values;
+  u8 *states;
+  u32 count;
+  u32 tombstones;
+  u32 capacity;
+};
+
+template <typename K, typename V>
+void HashMapAllocate(HashMap<K, V> *map, u32 capacity)
+{
+  assert(IsPowerOfTwo(capacity));
+  map->keys = PushArrayNoZero<K>(map->arena, capacity);
+  map->values = PushArrayNoZero<V>(map->arena, capacity);
+  map->states = PushArray<u8>(map->arena, capacity);
+  map->count = 0;
+  map->tombstones = 0;
+  map->capacity = capacity;
+}
+
+template <typename K, typename V>
+HashMap<K, V> HashMapInit(Arena *arena, u32 capacity)
+{
+  HashMap<K, V> map = {
+    .arena = arena,
+  };
+  u32 rounded = 16;
+  while (rounded < capacity)
+  {
+    rounded *= 2;
+  }
+  HashMapAllocate(&map, rounded);
+  return map;
+}
+
+// returns the slot holding key, or the slot it should be inserted at
+template <typename K, typename V>
+u32 HashMapFindSlot(HashMap<K, V> *map, const K &key, bool *found)
+{
+  u32 mask = map->capacity - 1;
+  u32 index = (u32)HashKey(key) & mask;
+  u32 insert_at = UINT32_MAX;
+
+  for (u32 probe = 0; probe < map->capacity; probe++)
+  {
+    u8 state = map->states[index];
+    if (state == HASH_SLOT_EMPTY)
+    {
+      *found = false;
+      return insert_at != UINT32_MAX ? insert_at : index;
+    }
+    if (state == HASH_SLOT_TOMBSTONE)
+    {
+      if (insert_at == UINT32_MAX)
+      {
+        insert_at = index;
+      }
+    }
+    else if (HashKeyEquals(map->keys[index], key))
+    {
+      *found = true;
+      return index;
+    }
+    index = (index + 1) & mask;
+  }
+
+  *found = false;
+  return insert_at;
+}
+
+template <typename K, typename V>
+void HashMapGrow(HashMap<K, V> *map, u32 capacity)
+{
+  HashMap<K, V> old = *map;
+  HashMapAllocate(map, capacity);
+
+  for (u32 i = 0; i < old.capacity; i++)
+  {
+    if (old.states[i] != HASH_SLOT_FULL)
+    {
+      continue;
+    }
+    bool found;
+    u32 slot = HashMapFindSlot(map, old.keys[i], &found);
+    map->keys[slot] = old.keys[i];
+    map->values[slot] = old.values[i];
+    map->states[slot] = HASH_SLOT_FULL;
+    map->count += 1;
+  }
+}
+
+// inserts or overwrites, returns a pointer to the stored value
+template <typename K, typename V>
+V *HashMapPut(HashMap<K, V> *map, const K &key, const V &value)
+{
+  // keep the load factor including tombstones under 3/4
+  if ((map->count + map->tombstones + 1) * 4 > map->capacity * 3)
+  {
+    u32 capacity =
+      (map->count + 1) * 2 > map->capacity ? map->capacity * 2 : map->capacity;
+    HashMapGrow(map, capacity);
+  }
+
+  bool found;
+  u32 slot = HashMapFindSlot(map, key, &found);
+  if (!found)
+  {
+    if (map->states[slot] == HASH_SLOT_TOMBSTONE)
+    {
+      map->tombstones -= 1;
+    }
+    map->keys[slot] = key;
+    map->states[slot] = HASH_SLOT_FULL;
+    map->count += 1;
+  }
+  map->values[slot] = value;
+  return &map->values[slot];
+}
+
+// returns the value stored under key, inserting value first if the key is
+// new. inserted tells the caller which happened. one probe either way
+template <typename K, typename V>
+V *HashMapGetOrPut(HashMap<K, V> *map,
+                   const K &key,
+                   const V &value,
+                   bool *inserted)
+{
+  if ((map->count + map->tombstones + 1) * 4 > map->capacity * 3)
+  {
+    u32 capacity =
+      (map->count + 1) * 2 > map->capacity ? map->capacity * 2 : map->capacity;
+    HashMapGrow(map, capacity);
+  }
+
+  bool found;
+  u32 slot = HashMapFindSlot(map, key, &found);
+  *inserted = !found;
+  if (!found)
+  {
+    if (map->states[slot] == HASH_SLOT_TOMBSTONE)
+    {
+      map->tombstones -= 1;
+    }
+    map->keys[slot] = key;
+    map->values[slot] = value;
+    map->states[slot] = HASH_SLOT_FULL;
+    map->count += 1;
+  }
+  return &map->values[slot];
+}
+
+template <typename K, typename V>
+V *HashMapGet(HashMap<K, V> *map, const K &key)
+{
+  bool found;
+  u32 slot = HashMapFindSlot(map, key, &found);
+  return found ? &map->values[slot] : NULL;
+}
+
+template <typename K, typename V>
+bool HashMapRemove(HashMap<K, V> *map, const K &key)
+{
+  bool found;
+  u32 slot = HashMapFindSlot(map, key, &found);
+  if (!found)
+  {
+    return false;
+  }
+  map->states[slot] = HASH_SLOT_TOMBSTONE;
+  map->count -= 1;
+  map->tombstones += 1;
+  return true;
+}
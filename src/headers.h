@@ -3,7 +3,12 @@
 #define VK_NO_PROTOTYPES
 #include "HandmadeMath.h"
 #include "arena.h"
+#include "array.h"
 #include "cgltf.h"
+#include "concurrent_arena.h"
+#include "hash_map.h"
+#include "jobs.h"
+#include "pool.h"
 #include "types.h"
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_vulkan.h>
@@ -11,6 +16,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 //
 #include <volk.h>
 //
@@ -32,6 +40,8 @@ struct FrameContext
   VkFence fence;
   VkCommandPool command_pool;
   VkCommandBuffer command_buffer;
+  // cpu transient memory for this frame, only reset once fence has signaled
+  Arena arena;
 };
 
 struct Vertex
@@ -41,24 +51,238 @@ struct Vertex
   float u, v;
 };
 
+// 16 byte vertex. position is unorm16 inside the owning mesh's bounds with w
+// unused, the normal is octahedral snorm16 and the uv is half float
+struct CompactVertex
+{
+  u16 x, y, z, w;
+  u16 octahedral_x, octahedral_y;
+  u16 u, v;
+};
+
+enum VertexFormat
+{
+  VERTEX_FORMAT_FLOAT = 0,
+  VERTEX_FORMAT_COMPACT = 1,
+};
+
+#define MESH_MAX_LODS 4
+
+// one level of detail, an index range over the full mesh's vertices
+struct MeshLod
+{
+  u32 index_offset;
+  u32 index_count;
+  // object space distance the level can stray from lod 0
+  float error;
+};
+
 struct MeshRegion
 {
   u32 vertex_offset;
+  // in indices of index_type from the start of the buffer
   u32 index_offset;
   u32 vertex_count;
   u32 index_count;
+  // VK_INDEX_TYPE_UINT16 whenever every vertex is reachable with 16 bits
+  VkIndexType index_type;
+  // into MegaBuffer meshlets
+  u32 first_meshlet;
+  u32 meshlet_count;
+  // lods[0] matches index_offset / index_count
+  u32 lod_count;
+  MeshLod lods[MESH_MAX_LODS];
+  // spans in the mega buffer's virtual block
+  VmaVirtualAllocation vertex_allocation;
+  VmaVirtualAllocation index_allocation;
+};
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// triangle cluster of one region, see meshlet.cpp
+struct Meshlet
+{
+  // into meshlet_vertices, which holds region local vertex indices
+  u32 vertex_offset;
+  // into meshlet_triangles, 3 meshlet local indices per triangle
+  u32 triangle_offset;
+  u32 vertex_count;
+  u32 triangle_count;
+  HMM_Vec3 center;
+  float radius;
+  // backfacing when dot(normalize(cone_apex - camera), cone_axis) >=
+  // cone_cutoff, a cutoff of 1 never culls
+  HMM_Vec3 cone_apex;
+  HMM_Vec3 cone_axis;
+  float cone_cutoff;
+};
+
+// object space bounds of a primitive, the sphere is centered on the box
+struct MeshBounds
+{
+  HMM_Vec3 min;
+  HMM_Vec3 max;
+  HMM_Vec3 center;
+  float radius;
+};
+
+// cpu side mesh data before it goes into the mega buffer
+struct RawMesh
+{
+  Vertex *vertices;
+  // every lod's indices back to back, lod 0 first
+  u32 *indices;
+  u32 vertex_count;
+  u32 index_count;
+  u32 lod_count;
+  MeshLod lods[MESH_MAX_LODS];
+  MeshBounds bounds;
+  // set instead of vertices and indices while they are still packed in a
+  // mapped cache, the upload decodes them straight into the staging ring
+  const u8 *packed_vertices;
+  const u8 *packed_indices;
+  u64 packed_vertex_size;
+  u64 packed_index_size;
+};
+
+// a glTF mesh, one region per primitive. lives in the mega buffer's pool,
+// its handle indexes the table pointing at it
+struct Mesh
+{
+  u32 first_region;
+  u32 region_count;
+  // compact positions decode as min + unorm * scale, float vertices use the
+  // identity (0, 1)
+  HMM_Vec3 position_min;
+  HMM_Vec3 position_scale;
+  // upload ticket of the mesh's data, drawn once the graphics queue has it
+  u64 ticket;
+};
+
+// per region bounds as a structure of arrays, row i belongs to regions[i].
+// visibility passes stream one column at a time instead of striding through
+// MeshRegion
+struct RegionBoundsTable
+{
+  Array<float> min_x;
+  Array<float> min_y;
+  Array<float> min_z;
+  Array<float> max_x;
+  Array<float> max_y;
+  Array<float> max_z;
+  Array<float> center_x;
+  Array<float> center_y;
+  Array<float> center_z;
+  Array<float> radius;
 };
 
-#define MAX_MESHES 16
+#define MEGA_BUFFER_SIZE megabytes(512)
+#define MEGA_BUFFER_INVALID_MESH UINT32_MAX
+
+// a span released while frames in flight may still read it
+struct MegaBufferFree
+{
+  VmaVirtualAllocation allocation;
+  u64 retire_frame;
+  // an upload may still be writing it
+  u64 ticket;
+};
 
+// one device local buffer for every mesh. vertex and index spans are
+// sub-allocated through a vma virtual block so meshes come and go without
+// touching the rest, see mega_buffer.cpp
 struct MegaBuffer
 {
   VkBuffer buffer;
   VmaAllocation allocation;
-  MeshRegion regions[MAX_MESHES];
-  u64 vertex_region_offset;
-  u64 index_region_offset;
-  u32 mesh_count;
+  VmaVirtualBlock block;
+  u64 size;
+  // meshes own contiguous runs of regions, both stay compact on removal
+  Array<MeshRegion> regions;
+  // handle -> mesh, NULL while the handle is free. meshes come and go one at
+  // a time so they sit in a pool rather than a compacted array
+  Pool<Mesh> mesh_pool;
+  Array<Mesh *> meshes;
+  Array<u32> free_meshes;
+  // one row per region, kept in step with regions
+  RegionBoundsTable region_bounds;
+  // cpu side clusters for culling, regions own contiguous runs
+  Array<Meshlet> meshlets;
+  Array<u32> meshlet_vertices;
+  Array<u8> meshlet_triangles;
+  Array<MegaBufferFree> pending_frees;
+  // counts MegaBufferBeginFrame calls
+  u64 frame;
+  // highest upload ticket the graphics queue may read, see Uploader
+  u64 ready_ticket;
+  // VertexFormat, the pipeline's vertex input is built to match
+  u32 vertex_format;
+  u32 vertex_stride;
+};
+
+// one mesh's cpu data on its way into the mega buffer. meshlets points at the
+// mesh's first meshlet, its offsets index meshlet_vertices / meshlet_triangles
+struct MeshSource
+{
+  RawMesh *primitives;
+  u32 primitive_count;
+  const u32 *primitive_meshlet_counts;
+  const Meshlet *meshlets;
+  const u32 *meshlet_vertices;
+  const u8 *meshlet_triangles;
+};
+
+#define UPLOAD_RING_SIZE megabytes(64)
+// largest single reservation, bigger uploads are written in chunks
+#define UPLOAD_MAX_RESERVE megabytes(4)
+
+struct UploadCopy
+{
+  VkBuffer buffer;
+  VkBufferCopy region;
+};
+
+// copies submitted on the transfer queue together. its ticket is the timeline
+// value the submit signals
+struct UploadBatch
+{
+  u64 ticket;
+  VkCommandBuffer command_buffer;
+  // destination ranges, needed again for the acquire barriers
+  UploadCopy *copies;
+  u32 copy_count;
+  // ring head after the batch's last reservation, the tail moves here once
+  // the ticket completes
+  u64 ring_end;
+};
+
+// copies into device local buffers run on the transfer queue and never block
+// the frame loop. data goes through one persistently mapped staging ring, and
+// everything reserved between flushes is submitted as one batch with a single
+// copy command per destination. the graphics queue waits on the timeline
+// semaphore, and takes ownership of the ranges when the transfer queue is its
+// own family
+struct Uploader
+{
+  VkCommandPool command_pool;
+  VkSemaphore timeline;
+  // ticket of the open batch
+  u64 next_ticket;
+  // highest ticket the graphics queue has acquired
+  u64 acquired_ticket;
+  VkBuffer ring_buffer;
+  VmaAllocation ring_allocation;
+  u8 *ring;
+  // bytes ever reserved / released, the ring offset is head % size
+  u64 ring_head;
+  u64 ring_tail;
+  // reserved since the last flush
+  Array<UploadCopy> open_copies;
+  // submitted and not yet acquired, in ticket order
+  Array<UploadBatch> batches;
+  // batch copies, reset whenever nothing is open or in flight
+  Arena arena;
 };
 
 struct VertexBuffer
@@ -74,6 +298,9 @@ struct Context
   VkPhysicalDevice gpu;
   VkQueue queue;
   u32 queue_index;
+  // a transfer only family when the gpu has one, otherwise the graphics queue
+  VkQueue transfer_queue;
+  u32 transfer_queue_index;
   VkDevice device;
   VmaAllocator allocator;
   FrameContext frame_context[FRAMES_IN_FLIGHT];
@@ -103,12 +330,14 @@ struct State
   Swapchain *swapchain;
 
   MegaBuffer mega_buffer;
+  // mega buffer handle of every loaded mesh, in load order
+  Array<u32> mesh_handles;
+  Uploader uploader;
 
   int resize_ticker;
 
   Arena permanent_arena;
   Arena swapchain_arena;
-  Arena scratch_arena;
 };
 
 // macros
@@ -174,6 +403,138 @@ inline const char *vk_debug_string(VkResult code)
 // DEFINED RECREATE SWAPCHAIN HERE
 void RecreateVulkanSwapchain(State *state);
 
+// read only file mapping
+struct MappedFile
+{
+  void *data;
+  u64 size;
+};
+
+bool MapFile(const char *path, MappedFile *file);
+void UnmapFile(MappedFile *file);
+
+// mesh processing stages, see mesh_process.cpp
+enum MeshProcessFlags
+{
+  MESH_PROCESS_WELD = 1 << 0,
+  MESH_PROCESS_VERTEX_CACHE = 1 << 1,
+  MESH_PROCESS_VERTEX_FETCH = 1 << 2,
+  MESH_PROCESS_LOD = 1 << 3,
+  MESH_PROCESS_ALL = MESH_PROCESS_WELD | MESH_PROCESS_VERTEX_CACHE |
+                     MESH_PROCESS_VERTEX_FETCH | MESH_PROCESS_LOD,
+};
+
+// each lod aims for this fraction of the previous level's triangles and gives
+// up once it would stray further than the error, relative to the mesh extent
+#define MESH_LOD_RATIO 0.5f
+#define MESH_LOD_MAX_ERROR 0.05f
+// screen space error in pixels a lod may show before a finer one is drawn
+#define MESH_LOD_PIXEL_ERROR 1.0f
+
+// entries in the simulated post transform cache, matches what tipsify
+// optimizes for
+#define VERTEX_CACHE_SIZE 16
+
+struct VertexCacheStats
+{
+  // cache misses per triangle, 0.5 is the floor for regular grids, 3 is worst
+  float acmr;
+  // cache misses per unique vertex, 1.0 is ideal
+  float atvr;
+};
+
+
+// stages the runtime loader runs on freshly parsed meshes
+extern u32 g_mesh_process_flags;
+extern float g_weld_epsilon;
+void WeldVertices(RawMesh *mesh, float epsilon);
+void OptimizeVertexFetch(RawMesh *mesh);
+VertexCacheStats AnalyzeVertexCache(RawMesh *mesh, u32 cache_size);
+void OptimizeVertexCache(RawMesh *mesh, u32 cache_size);
+RawMesh RawMeshLod(RawMesh *mesh, u32 lod);
+void GenerateLods(RawMesh *mesh, Arena *arena, float ratio, float max_error);
+void ProcessMesh(RawMesh *mesh, Arena *arena, u32 flags);
+void ComputeMeshBounds(RawMesh *mesh);
+
+u32 BuildMeshlets(RawMesh *mesh,
+                  Array<Meshlet> *meshlets,
+                  Array<u32> *meshlet_vertices,
+                  Array<u8> *meshlet_triangles);
+
+// vertex format the mega buffer is built with
+extern u32 g_vertex_format;
+void ComputePositionBounds(RawMesh *mesh, HMM_Vec3 *min, HMM_Vec3 *max);
+void QuantizeVertices(CompactVertex *out,
+                      const Vertex *in,
+                      u32 count,
+                      HMM_Vec3 position_min,
+                      HMM_Vec3 position_scale);
+
+// lossless stream packing for the cooked cache, see mesh_codec.cpp
+#define MESH_CODEC_BLOCK 256
+
+// where a packed stream's decoding left off, streams decode a few blocks at a
+// time straight into the staging ring
+struct MeshCodecReader
+{
+  const u8 *in;
+  const u8 *end;
+  // the deltas of the next block start from the last element decoded
+  u8 previous_vertex[sizeof(Vertex)];
+  u32 previous_index;
+};
+
+u64 MeshCodecBound(u32 count, u32 stride);
+u64 EncodeVertexStream(u8 *out, const Vertex *vertices, u32 count);
+u64 EncodeIndexStream(u8 *out, const u32 *indices, u32 count);
+bool MeshCodecStreamValid(u32 count, u32 stride, const u8 *data, u64 size);
+void MeshCodecReaderInit(MeshCodecReader *reader, const u8 *data, u64 size);
+bool DecodeVertexBlocks(MeshCodecReader *reader, Vertex *out, u32 count);
+bool DecodeIndexBlocks(MeshCodecReader *reader,
+                       u32 *out,
+                       u32 count,
+                       u32 max_index,
+                       bool *clamped);
+
+// how the cache stores vertex and index blobs. raw caches are mapped and used
+// in place, packed ones are smaller on disk and decoded while uploading
+enum MeshCacheCodec
+{
+  MESH_CACHE_CODEC_RAW = 0,
+  MESH_CACHE_CODEC_PACKED = 1,
+};
+
+// one per mesh file, results land in the job's own arena so workers never
+// share memory. primitives are stored flat, mesh_primitive_counts says how
+// many consecutive primitives belong to each glTF mesh
+struct MeshLoadJob
+{
+  const char *path;
+  Arena arena;
+  Array<RawMesh> primitives;
+  Array<u32> mesh_primitive_counts;
+  // set when primitives or meshlets point into a mapped cache file
+  MappedFile cache;
+  // meshlets of every primitive back to back, offsets local to the job
+  Array<Meshlet> meshlets;
+  Array<u32> meshlet_vertices;
+  Array<u8> meshlet_triangles;
+  Array<u32> primitive_meshlet_counts;
+};
+
+// cooked mesh cache, see mesh_cache.cpp
+extern int g_mesh_cache_enabled;
+extern u32 g_mesh_cache_codec;
+bool LoadMeshCache(MeshLoadJob *job, u32 process_flags);
+u64 WriteMeshCache(MeshLoadJob *job, u32 writer_id, u32 process_flags);
+
+// cpu side import, see mesh.cpp
+void InitMeshLoadJob(MeshLoadJob *job);
+void ReleaseMeshLoadJob(MeshLoadJob *job);
+void ParseMeshFile(MeshLoadJob *job);
+void BuildMeshFileMeshlets(MeshLoadJob *job);
+void LoadMeshFiles(MeshLoadJob *jobs, u32 job_count);
+
 #define validate(error, format, ...)                                           \
   {                                                                            \
     if (error != VK_SUCCESS)                                                   \
@@ -212,3 +573,4 @@ extern int g_debug_enabled;
   }
 
 #define megabytes(n) ((u64)(n) * 1024 * 1024)
+#define gigabytes(n) ((u64)(n) * 1024 * 1024 * 1024)
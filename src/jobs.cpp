@@ -0,0 +1,74 @@
+#include "headers.h"
+
+#define MAX_WORKER_THREADS 64
+
+struct ParallelForContext
+{
+  ParallelForFunc fn;
+  void *user;
+  u32 count;
+  SDL_AtomicInt next;
+};
+
+static void ParallelForRun(ParallelForContext *context)
+{
+  for (;;)
+  {
+    u32 index = (u32)SDL_AddAtomicInt(&context->next, 1);
+    if (index >= context->count)
+    {
+      break;
+    }
+    context->fn(context->user, index);
+  }
+}
+
+static int ParallelForWorker(void *data)
+{
+  ParallelForRun((ParallelForContext *)data);
+  // worker threads die here, give their scratch arenas back
+  ReleaseThreadScratch();
+  return 0;
+}
+
+void ParallelFor(u32 count, ParallelForFunc fn, void *user)
+{
+  ParallelForContext context = {
+    .fn = fn,
+    .user = user,
+    .count = count,
+  };
+  SDL_SetAtomicInt(&context.next, 0);
+
+  u32 thread_count = (u32)SDL_GetNumLogicalCPUCores();
+  if (thread_count > count)
+  {
+    thread_count = count;
+  }
+  if (thread_count > MAX_WORKER_THREADS)
+  {
+    thread_count = MAX_WORKER_THREADS;
+  }
+
+  // the calling thread is one of the workers
+  SDL_Thread *threads[MAX_WORKER_THREADS];
+  u32 spawned = 0;
+  for (u32 i = 1; i < thread_count; i++)
+  {
+    SDL_Thread *thread =
+      SDL_CreateThread(ParallelForWorker, "worker", &context);
+    if (thread == NULL)
+    {
+      debug("could not spawn worker thread: %s", SDL_GetError());
+      break;
+    }
+    threads[spawned++] = thread;
+  }
+
+  ParallelForRun(&context);
+
+  for (u32 i = 0; i < spawned; i++)
+  {
+    SDL_WaitThread(threads[i], NULL);
+  }
+}
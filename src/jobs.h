@@ -0,0 +1,10 @@
+#pragma once
+
+#include "types.h"
+
+typedef void (*ParallelForFunc)(void *user, u32 index);
+
+// runs fn(user, i) for every i in [0, count) across a pool of worker threads
+// plus the calling thread, returns once every index is done. indices are
+// handed out in order but may finish in any order
+void ParallelFor(u32 count, ParallelForFunc fn, void *user);
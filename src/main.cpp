@@ -1,9 +1,18 @@
 #include "headers.h"
 
 #include "arena.cpp"
+#include "concurrent_arena.cpp"
 
 #include "context.cpp"
+#include "jobs.cpp"
+#include "mesh_cache.cpp"
+#include "mesh_codec.cpp"
+#include "upload.cpp"
+#include "mega_buffer.cpp"
 #include "mesh.cpp"
+#include "mesh_process.cpp"
+#include "meshlet.cpp"
+#include "simplify.cpp"
 #include "pipeline.cpp"
 #include "surface.cpp"
 //
@@ -15,18 +24,53 @@ int g_debug_enabled = 0;
 
 int main(int argc, char **argv)
 {
-
+  u32 huge_page_flags = 0;
   for (int i = 1; i < argc; i++)
   {
     if (strcmp(argv[i], "-d") == 0)
     {
       g_debug_enabled = 1;
     }
+    if (strcmp(argv[i], "-hugepages") == 0)
+    {
+      huge_page_flags = ARENA_FLAG_HUGE_PAGES;
+    }
+    if (strcmp(argv[i], "-hugetlb-limit") == 0 && i + 1 < argc)
+    {
+      g_arena_hugetlb_limit = megabytes(strtoull(argv[++i], NULL, 10));
+    }
+    if (strcmp(argv[i], "-nocache") == 0)
+    {
+      g_mesh_cache_enabled = 0;
+    }
+    if (strcmp(argv[i], "-rawcache") == 0)
+    {
+      g_mesh_cache_codec = MESH_CACHE_CODEC_RAW;
+    }
+    if (strcmp(argv[i], "-weld-epsilon") == 0 && i + 1 < argc)
+    {
+      g_weld_epsilon = (float)atof(argv[++i]);
+    }
+    if (strcmp(argv[i], "-compact") == 0)
+    {
+      g_vertex_format = VERTEX_FORMAT_COMPACT;
+    }
+    if (strcmp(argv[i], "-optimize") == 0)
+    {
+      g_mesh_process_flags |=
+        MESH_PROCESS_VERTEX_CACHE | MESH_PROCESS_VERTEX_FETCH;
+    }
   }
   State state = {};
-  state.scratch_arena = ArenaInit(malloc(megabytes(8)), megabytes(8));
-  state.permanent_arena = ArenaInit(malloc(megabytes(16)), megabytes(16));
-  state.swapchain_arena = ArenaInit(malloc(megabytes(16)), megabytes(16));
+  // arenas only reserve address space, pages get committed as they grow
+  // transient memory comes from the per-thread pool in GetScratch
+  g_scratch_arena_flags |= huge_page_flags;
+  state.permanent_arena =
+    ArenaReserve(gigabytes(4), ARENA_FLAG_VIRTUAL | huge_page_flags);
+  debug("permanent arena using %s", ArenaPageMode(&state.permanent_arena));
+  state.swapchain_arena = ArenaReserve(megabytes(64), ARENA_FLAG_VIRTUAL);
+  ArenaSetName(&state.permanent_arena, "permanent");
+  ArenaSetName(&state.swapchain_arena, "swapchain");
   // create context
   state.context = (Context *)ArenaPush(&state.permanent_arena, sizeof(Context));
   CreateVulkanContext(&state);
@@ -42,7 +86,10 @@ int main(int argc, char **argv)
     "assets/Sphere.glb",
   };
   int num_paths = sizeof(mesh_paths) / sizeof(mesh_paths[0]);
-  CreateMegaBuffer(&state, mesh_paths, num_paths);
+  CreateUploader(&state);
+  CreateMegaBuffer(&state, MEGA_BUFFER_SIZE);
+  state.mesh_handles = ArrayInit<u32>(&state.permanent_arena, 16);
+  LoadMeshes(&state, mesh_paths, num_paths, &state.mesh_handles);
   CreatePipeline(&state);
   int running = 1;
   int frame_index = 0;
@@ -62,6 +109,16 @@ int main(int argc, char **argv)
         state.resize_ticker = 10;
         RecreateVulkanSwapchain(&state);
       }
+      if (event.type == SDL_EVENT_KEY_DOWN && event.key.key == SDLK_F1)
+      {
+        ArenaDumpStats(stdout);
+        MegaBufferDumpStats(&state.mega_buffer, stdout);
+      }
+      if (event.type == SDL_EVENT_KEY_DOWN && event.key.key == SDLK_F5)
+      {
+        debug("reloading meshes");
+        ReloadMeshes(&state, mesh_paths, num_paths, &state.mesh_handles);
+      }
     }
 
     // if (state.resize_ticker > 0)
@@ -76,5 +133,6 @@ int main(int argc, char **argv)
     // RenderLoop2(&state, frame_index);
     frame_index = (frame_index + 1) % FRAMES_IN_FLIGHT;
   }
+  ArenaDumpStats(stdout);
   return 0;
 }
@@ -0,0 +1,817 @@
+#include "headers.h"
+
+// mega buffer
+//     one long lived device local buffer with a vma virtual block on top.
+//     every primitive gets a vertex span and an index span, so meshes are
+//     added and removed at runtime without reallocating or moving anything
+//     else on the gpu. spans of removed meshes are held back until every frame
+//     that could still draw them has retired
+//
+
+// every column in one fixed order so rows are added and removed alike
+#define REGION_BOUNDS_COLUMNS 10
+static void RegionBoundsColumns(RegionBoundsTable *table,
+                                Array<float> **columns)
+{
+  columns[0] = &table->min_x;
+  columns[1] = &table->min_y;
+  columns[2] = &table->min_z;
+  columns[3] = &table->max_x;
+  columns[4] = &table->max_y;
+  columns[5] = &table->max_z;
+  columns[6] = &table->center_x;
+  columns[7] = &table->center_y;
+  columns[8] = &table->center_z;
+  columns[9] = &table->radius;
+}
+
+static void RegionBoundsInit(RegionBoundsTable *table,
+                             Arena *arena,
+                             u32 capacity)
+{
+  Array<float> *columns[REGION_BOUNDS_COLUMNS];
+  RegionBoundsColumns(table, columns);
+  for (u32 i = 0; i < REGION_BOUNDS_COLUMNS; i++)
+  {
+    *columns[i] = ArrayInit<float>(arena, capacity);
+  }
+}
+
+static void RegionBoundsPush(RegionBoundsTable *table, const MeshBounds *bounds)
+{
+  float row[REGION_BOUNDS_COLUMNS] = {
+    bounds->min.X,    bounds->min.Y,    bounds->min.Z,
+    bounds->max.X,    bounds->max.Y,    bounds->max.Z,
+    bounds->center.X, bounds->center.Y, bounds->center.Z,
+    bounds->radius,
+  };
+  Array<float> *columns[REGION_BOUNDS_COLUMNS];
+  RegionBoundsColumns(table, columns);
+  for (u32 i = 0; i < REGION_BOUNDS_COLUMNS; i++)
+  {
+    ArrayPush(columns[i], row[i]);
+  }
+}
+
+static void RegionBoundsRemoveRange(RegionBoundsTable *table,
+                                    u32 first,
+                                    u32 count)
+{
+  Array<float> *columns[REGION_BOUNDS_COLUMNS];
+  RegionBoundsColumns(table, columns);
+  for (u32 i = 0; i < REGION_BOUNDS_COLUMNS; i++)
+  {
+    ArrayRemoveRange(columns[i], first, count);
+  }
+}
+
+void CreateMegaBuffer(State *state, u64 size)
+{
+  MegaBuffer *mega_buffer = &state->mega_buffer;
+  mega_buffer->size = size;
+  mega_buffer->vertex_format = g_vertex_format;
+  mega_buffer->vertex_stride = g_vertex_format == VERTEX_FORMAT_COMPACT
+                                 ? sizeof(CompactVertex)
+                                 : sizeof(Vertex);
+
+  VkBufferCreateInfo buffer_info = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .size = size,
+    .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+             VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+
+  VmaAllocationCreateInfo alloc_info = {
+    .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+  };
+
+  validate(vmaCreateBuffer(state->context->allocator,
+                           &buffer_info,
+                           &alloc_info,
+                           &mega_buffer->buffer,
+                           &mega_buffer->allocation,
+                           NULL),
+           "could not create mega buffer on gpu");
+
+  VmaVirtualBlockCreateInfo block_info = {
+    .size = size,
+  };
+  validate(vmaCreateVirtualBlock(&block_info, &mega_buffer->block),
+           "could not create mega buffer virtual block");
+
+  Arena *arena = &state->permanent_arena;
+  mega_buffer->regions = ArrayInit<MeshRegion>(arena, 64);
+  RegionBoundsInit(&mega_buffer->region_bounds, arena, 64);
+  mega_buffer->mesh_pool = PoolInit<Mesh>(arena);
+  mega_buffer->meshes = ArrayInit<Mesh *>(arena, 16);
+  mega_buffer->free_meshes = ArrayInit<u32>(arena, 16);
+  mega_buffer->meshlets = ArrayInit<Meshlet>(arena, 0);
+  mega_buffer->meshlet_vertices = ArrayInit<u32>(arena, 0);
+  mega_buffer->meshlet_triangles = ArrayInit<u8>(arena, 0);
+  mega_buffer->pending_frees = ArrayInit<MegaBufferFree>(arena, 64);
+  debug("created %.1f MB mega buffer", size / (1024.0 * 1024.0));
+}
+
+// narrows indices that are known to fit in 16 bits
+static void narrow_indices(u16 *out, const u32 *in, u32 count)
+{
+  u32 i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+  // packs_epi32 saturates signed, bias into its range and flip the top bit
+  // back afterwards
+  __m128i bias = _mm_set1_epi32(32768);
+  __m128i flip = _mm_set1_epi16((short)0x8000);
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i lo =
+      _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(in + i)), bias);
+    __m128i hi =
+      _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(in + i + 4)), bias);
+    _mm_storeu_si128((__m128i *)(out + i),
+                     _mm_xor_si128(_mm_packs_epi32(lo, hi), flip));
+  }
+#endif
+  for (; i < count; i++)
+  {
+    out[i] = (u16)in[i];
+  }
+}
+
+// zero sized spans don't get an allocation, VK_NULL_HANDLE frees as a no-op
+static bool AllocateSpan(MegaBuffer *mega_buffer,
+                         u64 size,
+                         u64 alignment,
+                         VmaVirtualAllocation *allocation,
+                         u64 *offset)
+{
+  *allocation = VK_NULL_HANDLE;
+  *offset = 0;
+  if (size == 0)
+  {
+    return true;
+  }
+  VmaVirtualAllocationCreateInfo info = {
+    .size = size,
+    .alignment = alignment,
+  };
+  return vmaVirtualAllocate(mega_buffer->block, &info, allocation, offset) ==
+         VK_SUCCESS;
+}
+
+// packed streams that need converting decode this many elements at a time
+// into scratch, small enough to stay in cache on the way into the ring
+#define MEGA_BUFFER_DECODE_CHUNK (16 * MESH_CODEC_BLOCK)
+
+// streams a primitive's vertices through the staging ring into its span,
+// converting on the way. packed vertices decode straight into the ring, or
+// through a small scratch chunk when they also need quantizing. returns the
+// upload ticket
+static u64 UploadVertices(State *state,
+                          MegaBuffer *mega_buffer,
+                          const Mesh *mesh,
+                          const RawMesh *primitive,
+                          u64 offset)
+{
+  u32 stride = mega_buffer->vertex_stride;
+  // whole codec blocks per reservation so a packed stream resumes cleanly
+  u32 chunk = UPLOAD_MAX_RESERVE / stride / MESH_CODEC_BLOCK * MESH_CODEC_BLOCK;
+  bool compact = mega_buffer->vertex_format == VERTEX_FORMAT_COMPACT;
+  MeshCodecReader reader;
+  MeshCodecReaderInit(
+    &reader, primitive->packed_vertices, primitive->packed_vertex_size);
+  ArenaTemp temp = GetScratch(NULL, 0);
+  Vertex *decoded = NULL;
+  if (primitive->packed_vertices && compact)
+  {
+    decoded = PushArrayNoZero<Vertex>(temp.arena, MEGA_BUFFER_DECODE_CHUNK);
+  }
+  bool ok = true;
+  u64 ticket = 0;
+  for (u32 first = 0; first < primitive->vertex_count; first += chunk)
+  {
+    u32 count = primitive->vertex_count - first < chunk
+                  ? primitive->vertex_count - first
+                  : chunk;
+    void *out = UploadReserve(state,
+                              mega_buffer->buffer,
+                              offset + (u64)first * stride,
+                              (u64)count * stride,
+                              &ticket);
+    if (decoded)
+    {
+      for (u32 done = 0; done < count; done += MEGA_BUFFER_DECODE_CHUNK)
+      {
+        u32 n = SDL_min(count - done, MEGA_BUFFER_DECODE_CHUNK);
+        if (!ok || !DecodeVertexBlocks(&reader, decoded, n))
+        {
+          ok = false;
+          memset(decoded, 0, sizeof(Vertex) * n);
+        }
+        QuantizeVertices((CompactVertex *)out + done,
+                         decoded,
+                         n,
+                         mesh->position_min,
+                         mesh->position_scale);
+      }
+    }
+    else if (primitive->packed_vertices)
+    {
+      if (!ok || !DecodeVertexBlocks(&reader, (Vertex *)out, count))
+      {
+        ok = false;
+        memset(out, 0, sizeof(Vertex) * count);
+      }
+    }
+    else if (compact)
+    {
+      QuantizeVertices((CompactVertex *)out,
+                       primitive->vertices + first,
+                       count,
+                       mesh->position_min,
+                       mesh->position_scale);
+    }
+    else
+    {
+      memcpy(out, primitive->vertices + first, sizeof(Vertex) * count);
+    }
+  }
+  ReleaseScratch(temp);
+  // the cache walked every stream on load, this only trips if the file
+  // changed under the mapping. the rest of the span is zeroed
+  if (!ok)
+  {
+    debug("packed vertex stream ran out after the cache was checked");
+  }
+  return ticket;
+}
+
+// same for indices, narrowing them when the region uses 16 bit ones. packed
+// 32 bit indices decode straight into the ring, 16 bit ones through scratch
+static u64 UploadIndices(State *state,
+                         MegaBuffer *mega_buffer,
+                         const MeshRegion *region,
+                         const RawMesh *primitive,
+                         u64 offset)
+{
+  u32 index_size =
+    region->index_type == VK_INDEX_TYPE_UINT16 ? sizeof(u16) : sizeof(u32);
+  u32 chunk =
+    UPLOAD_MAX_RESERVE / index_size / MESH_CODEC_BLOCK * MESH_CODEC_BLOCK;
+  u32 max_index = primitive->vertex_count ? primitive->vertex_count - 1 : 0;
+  MeshCodecReader reader;
+  MeshCodecReaderInit(
+    &reader, primitive->packed_indices, primitive->packed_index_size);
+  ArenaTemp temp = GetScratch(NULL, 0);
+  u32 *decoded = NULL;
+  if (primitive->packed_indices && index_size == sizeof(u16))
+  {
+    decoded = PushArrayNoZero<u32>(temp.arena, MEGA_BUFFER_DECODE_CHUNK);
+  }
+  bool ok = true;
+  bool clamped = false;
+  u64 ticket = 0;
+  for (u32 first = 0; first < primitive->index_count; first += chunk)
+  {
+    u32 count = primitive->index_count - first < chunk
+                  ? primitive->index_count - first
+                  : chunk;
+    void *out = UploadReserve(state,
+                              mega_buffer->buffer,
+                              offset + (u64)first * index_size,
+                              (u64)count * index_size,
+                              &ticket);
+    if (decoded)
+    {
+      for (u32 done = 0; done < count; done += MEGA_BUFFER_DECODE_CHUNK)
+      {
+        u32 n = SDL_min(count - done, MEGA_BUFFER_DECODE_CHUNK);
+        if (!ok ||
+            !DecodeIndexBlocks(&reader, decoded, n, max_index, &clamped))
+        {
+          ok = false;
+          memset(decoded, 0, sizeof(u32) * n);
+        }
+        narrow_indices((u16 *)out + done, decoded, n);
+      }
+    }
+    else if (primitive->packed_indices)
+    {
+      if (!ok ||
+          !DecodeIndexBlocks(&reader, (u32 *)out, count, max_index, &clamped))
+      {
+        ok = false;
+        memset(out, 0, sizeof(u32) * count);
+      }
+    }
+    else if (index_size == sizeof(u16))
+    {
+      narrow_indices((u16 *)out, primitive->indices + first, count);
+    }
+    else
+    {
+      memcpy(out, primitive->indices + first, sizeof(u32) * count);
+    }
+  }
+  ReleaseScratch(temp);
+  if (!ok)
+  {
+    debug("packed index stream ran out after the cache was checked");
+  }
+  if (clamped)
+  {
+    debug("packed indices past vertex %u after the cache was checked, "
+          "clamped",
+          max_index);
+  }
+  return ticket;
+}
+
+// inserts every source as a mesh and writes its data into the staging ring,
+// the copies go out with the next UploadFlush. handles gets one entry per
+// source, MEGA_BUFFER_INVALID_MESH when it didn't fit. returns the upload
+// ticket of the last mesh, 0 when there was nothing to copy
+u64 MegaBufferAddMeshes(State *state,
+                         MegaBuffer *mega_buffer,
+                         MeshSource *sources,
+                         u32 source_count,
+                         u32 *handles)
+{
+  ArenaTemp temp = GetScratch(NULL, 0);
+  Arena *scratch = temp.arena;
+  u32 stride = mega_buffer->vertex_stride;
+
+  u64 write_start = SDL_GetPerformanceCounter();
+  u64 ticket = 0;
+  u64 vertex_bytes = 0;
+  u64 index16_bytes = 0;
+  u64 index32_bytes = 0;
+  for (u32 s = 0; s < source_count; s++)
+  {
+    MeshSource *source = &sources[s];
+    handles[s] = MEGA_BUFFER_INVALID_MESH;
+
+    // reserve every span first so a mesh that doesn't fit leaves no trace
+    VmaVirtualAllocation *vertex_spans =
+      PushArray<VmaVirtualAllocation>(scratch, source->primitive_count);
+    VmaVirtualAllocation *index_spans =
+      PushArray<VmaVirtualAllocation>(scratch, source->primitive_count);
+    u64 *vertex_offsets = PushArray<u64>(scratch, source->primitive_count);
+    u64 *index_offsets = PushArray<u64>(scratch, source->primitive_count);
+    bool fits = true;
+    for (u32 p = 0; p < source->primitive_count && fits; p++)
+    {
+      RawMesh *primitive = &source->primitives[p];
+      u64 index_size = primitive->vertex_count <= 65536 ? sizeof(u16)
+                                                        : sizeof(u32);
+      fits = AllocateSpan(mega_buffer,
+                          (u64)stride * primitive->vertex_count,
+                          stride,
+                          &vertex_spans[p],
+                          &vertex_offsets[p]) &&
+             AllocateSpan(mega_buffer,
+                          index_size * primitive->index_count,
+                          index_size,
+                          &index_spans[p],
+                          &index_offsets[p]);
+    }
+    if (!fits)
+    {
+      for (u32 p = 0; p < source->primitive_count; p++)
+      {
+        vmaVirtualFree(mega_buffer->block, vertex_spans[p]);
+        vmaVirtualFree(mega_buffer->block, index_spans[p]);
+      }
+      debug("mega buffer has no room for a mesh of %u primitives",
+            source->primitive_count);
+      continue;
+    }
+
+    u32 handle;
+    if (mega_buffer->free_meshes.count > 0)
+    {
+      handle = mega_buffer->free_meshes[--mega_buffer->free_meshes.count];
+    }
+    else
+    {
+      handle = mega_buffer->meshes.count;
+      ArrayPush(&mega_buffer->meshes, (Mesh *)NULL);
+    }
+    handles[s] = handle;
+
+    Mesh *mesh = PoolAlloc(&mega_buffer->mesh_pool);
+    mega_buffer->meshes[handle] = mesh;
+    mesh->first_region = mega_buffer->regions.count;
+    mesh->region_count = source->primitive_count;
+
+    // every primitive of a mesh shares one quantization grid so they draw
+    // with the same transform
+    mesh->position_min = HMM_V3(0, 0, 0);
+    mesh->position_scale = HMM_V3(1, 1, 1);
+    if (mega_buffer->vertex_format == VERTEX_FORMAT_COMPACT)
+    {
+      // the stored bounds hold every position and need no pass over vertices
+      // that may still be packed
+      HMM_Vec3 min = HMM_V3(INFINITY, INFINITY, INFINITY);
+      HMM_Vec3 max = HMM_V3(-INFINITY, -INFINITY, -INFINITY);
+      for (u32 p = 0; p < source->primitive_count; p++)
+      {
+        RawMesh *primitive = &source->primitives[p];
+        if (primitive->vertex_count > 0)
+        {
+          MeshBounds *bounds = &primitive->bounds;
+          min = HMM_V3(fminf(min.X, bounds->min.X),
+                       fminf(min.Y, bounds->min.Y),
+                       fminf(min.Z, bounds->min.Z));
+          max = HMM_V3(fmaxf(max.X, bounds->max.X),
+                       fmaxf(max.Y, bounds->max.Y),
+                       fmaxf(max.Z, bounds->max.Z));
+        }
+      }
+      if (min.X <= max.X)
+      {
+        mesh->position_min = min;
+        mesh->position_scale = HMM_SubV3(max, min);
+      }
+    }
+
+    // the mesh's meshlets are contiguous in the source, rebase their offsets
+    // onto the shared arrays
+    u32 meshlet_count = 0;
+    for (u32 p = 0; p < source->primitive_count; p++)
+    {
+      meshlet_count += source->primitive_meshlet_counts[p];
+    }
+    u32 first_meshlet = mega_buffer->meshlets.count;
+    if (meshlet_count > 0)
+    {
+      const Meshlet *first = &source->meshlets[0];
+      const Meshlet *last = &source->meshlets[meshlet_count - 1];
+      u32 vertex_base = mega_buffer->meshlet_vertices.count;
+      u32 triangle_base = mega_buffer->meshlet_triangles.count;
+      ArrayAppend(&mega_buffer->meshlet_vertices,
+                  source->meshlet_vertices + first->vertex_offset,
+                  last->vertex_offset + last->vertex_count -
+                    first->vertex_offset);
+      ArrayAppend(&mega_buffer->meshlet_triangles,
+                  source->meshlet_triangles + first->triangle_offset,
+                  last->triangle_offset + last->triangle_count * 3 -
+                    first->triangle_offset);
+      Meshlet *meshlets =
+        ArrayAppend(&mega_buffer->meshlets, source->meshlets, meshlet_count);
+      for (u32 m = 0; m < meshlet_count; m++)
+      {
+        meshlets[m].vertex_offset += vertex_base - first->vertex_offset;
+        meshlets[m].triangle_offset += triangle_base - first->triangle_offset;
+      }
+    }
+
+    for (u32 p = 0; p < source->primitive_count; p++)
+    {
+      RawMesh *primitive = &source->primitives[p];
+      MeshRegion *region = ArrayPush(&mega_buffer->regions);
+      RegionBoundsPush(&mega_buffer->region_bounds, &primitive->bounds);
+      region->vertex_allocation = vertex_spans[p];
+      region->index_allocation = index_spans[p];
+      region->index_type = primitive->vertex_count <= 65536
+                             ? VK_INDEX_TYPE_UINT16
+                             : VK_INDEX_TYPE_UINT32;
+      u64 index_size =
+        region->index_type == VK_INDEX_TYPE_UINT16 ? sizeof(u16) : sizeof(u32);
+      region->vertex_offset = (u32)(vertex_offsets[p] / stride);
+      region->vertex_count = primitive->vertex_count;
+      region->index_offset = (u32)(index_offsets[p] / index_size);
+      region->index_count = primitive->lods[0].index_count;
+      // every lod's indices sit right after lod 0 in the span
+      region->lod_count = primitive->lod_count;
+      for (u32 k = 0; k < region->lod_count; k++)
+      {
+        region->lods[k] = primitive->lods[k];
+        region->lods[k].index_offset += region->index_offset;
+      }
+      region->first_meshlet = first_meshlet;
+      region->meshlet_count = source->primitive_meshlet_counts[p];
+      first_meshlet += region->meshlet_count;
+
+      // convert straight into the staging ring
+      u64 vertex_ticket =
+        UploadVertices(state, mega_buffer, mesh, primitive, vertex_offsets[p]);
+      u64 index_ticket =
+        UploadIndices(state, mega_buffer, region, primitive, index_offsets[p]);
+      ticket = vertex_ticket > ticket ? vertex_ticket : ticket;
+      ticket = index_ticket > ticket ? index_ticket : ticket;
+      vertex_bytes += (u64)stride * primitive->vertex_count;
+      *(index_size == sizeof(u16) ? &index16_bytes : &index32_bytes) +=
+        index_size * primitive->index_count;
+    }
+    // the ring may flush mid mesh, its last ticket covers all of it
+    mesh->ticket = ticket;
+  }
+
+  debug("wrote %.1f KB of %s vertices, %.1f KB u16 and %.1f KB u32 indices "
+        "in %.3f ms",
+        vertex_bytes / 1024.0,
+        mega_buffer->vertex_format == VERTEX_FORMAT_COMPACT ? "compact"
+                                                            : "float",
+        index16_bytes / 1024.0,
+        index32_bytes / 1024.0,
+        (double)(SDL_GetPerformanceCounter() - write_start) * 1000.0 /
+          (double)SDL_GetPerformanceFrequency());
+  ReleaseScratch(temp);
+  return ticket;
+}
+
+// loads every file in parallel and adds each of their glTF meshes to the mega
+// buffer in path order, so handles come out the same every run
+void LoadMeshes(State *state,
+                const char **mesh_paths,
+                int path_count,
+                Array<u32> *handles)
+{
+  ArenaTemp temp = GetScratch(&handles->arena, 1);
+  Arena *scratch = temp.arena;
+  debug("scratch arena using %s", ArenaPageMode(scratch));
+
+  // parse and extract every file in parallel
+  u64 load_start = SDL_GetPerformanceCounter();
+  MeshLoadJob *jobs = PushArray<MeshLoadJob>(scratch, path_count);
+  for (int i = 0; i < path_count; i++)
+  {
+    jobs[i].path = mesh_paths[i];
+  }
+  LoadMeshFiles(jobs, (u32)path_count);
+  if (path_count > 0)
+  {
+    debug("load job arenas using %s", ArenaPageMode(&jobs[0].arena));
+  }
+
+  // a source per glTF mesh pointing straight into its job's arrays
+  Array<MeshSource> sources = ArrayInit<MeshSource>(scratch, 16);
+  u32 primitive_total = 0;
+  u32 meshlet_total = 0;
+  for (int i = 0; i < path_count; i++)
+  {
+    MeshLoadJob *job = &jobs[i];
+    u32 next_primitive = 0;
+    u32 next_meshlet = 0;
+    for (u32 j = 0; j < job->mesh_primitive_counts.count; j++)
+    {
+      MeshSource *source = ArrayPush(&sources);
+      source->primitives = &job->primitives[next_primitive];
+      source->primitive_count = job->mesh_primitive_counts[j];
+      source->primitive_meshlet_counts =
+        &job->primitive_meshlet_counts[next_primitive];
+      source->meshlets = job->meshlets.data + next_meshlet;
+      source->meshlet_vertices = job->meshlet_vertices.data;
+      source->meshlet_triangles = job->meshlet_triangles.data;
+      for (u32 k = 0; k < source->primitive_count; k++)
+      {
+        next_meshlet += source->primitive_meshlet_counts[k];
+      }
+      next_primitive += source->primitive_count;
+    }
+    primitive_total += job->primitives.count;
+    meshlet_total += job->meshlets.count;
+  }
+  debug("loaded %u meshes (%u primitives, %u meshlets) in %.3f ms",
+        sources.count,
+        primitive_total,
+        meshlet_total,
+        (double)(SDL_GetPerformanceCounter() - load_start) * 1000.0 /
+          (double)SDL_GetPerformanceFrequency());
+
+  u32 first_handle = handles->count;
+  ArrayReserve(handles, first_handle + sources.count);
+  handles->count += sources.count;
+  MegaBufferAddMeshes(state,
+                      &state->mega_buffer,
+                      sources.data,
+                      sources.count,
+                      handles->data + first_handle);
+
+  for (int i = 0; i < path_count; i++)
+  {
+    ReleaseMeshLoadJob(&jobs[i]);
+  }
+  ReleaseScratch(temp);
+}
+
+// drops the mesh's cpu side data right away, its gpu spans once the frames
+// that might draw it are done. the mesh goes back to the pool and the handle
+// is reused by a later add
+void MegaBufferRemoveMesh(MegaBuffer *mega_buffer, u32 handle)
+{
+  if (handle >= mega_buffer->meshes.count ||
+      mega_buffer->meshes[handle] == NULL)
+  {
+    return;
+  }
+  Mesh *mesh = mega_buffer->meshes[handle];
+  u32 first_region = mesh->first_region;
+  u32 region_count = mesh->region_count;
+
+  u32 first_meshlet = mega_buffer->regions[first_region].first_meshlet;
+  u32 meshlet_count = 0;
+  for (u32 i = 0; i < region_count; i++)
+  {
+    MeshRegion *region = &mega_buffer->regions[first_region + i];
+    MegaBufferFree vertex_free = {
+      region->vertex_allocation,
+      mega_buffer->frame + FRAMES_IN_FLIGHT,
+      mesh->ticket,
+    };
+    MegaBufferFree index_free = {
+      region->index_allocation,
+      mega_buffer->frame + FRAMES_IN_FLIGHT,
+      mesh->ticket,
+    };
+    ArrayPush(&mega_buffer->pending_frees, vertex_free);
+    ArrayPush(&mega_buffer->pending_frees, index_free);
+    meshlet_count += region->meshlet_count;
+  }
+
+  // close the gaps in the cpu side arrays, everything past them moves down
+  if (meshlet_count > 0)
+  {
+    Meshlet *first = &mega_buffer->meshlets[first_meshlet];
+    Meshlet *last = &mega_buffer->meshlets[first_meshlet + meshlet_count - 1];
+    u32 vertex_start = first->vertex_offset;
+    u32 vertex_count = last->vertex_offset + last->vertex_count - vertex_start;
+    u32 triangle_start = first->triangle_offset;
+    u32 triangle_count =
+      last->triangle_offset + last->triangle_count * 3 - triangle_start;
+    ArrayRemoveRange(
+      &mega_buffer->meshlet_vertices, vertex_start, vertex_count);
+    ArrayRemoveRange(
+      &mega_buffer->meshlet_triangles, triangle_start, triangle_count);
+    ArrayRemoveRange(&mega_buffer->meshlets, first_meshlet, meshlet_count);
+    for (u32 i = first_meshlet; i < mega_buffer->meshlets.count; i++)
+    {
+      mega_buffer->meshlets[i].vertex_offset -= vertex_count;
+      mega_buffer->meshlets[i].triangle_offset -= triangle_count;
+    }
+  }
+
+  ArrayRemoveRange(&mega_buffer->regions, first_region, region_count);
+  RegionBoundsRemoveRange(
+    &mega_buffer->region_bounds, first_region, region_count);
+  for (u32 i = first_region; i < mega_buffer->regions.count; i++)
+  {
+    mega_buffer->regions[i].first_meshlet -= meshlet_count;
+  }
+  for (u32 i = 0; i < mega_buffer->meshes.count; i++)
+  {
+    Mesh *other = mega_buffer->meshes[i];
+    if (other && other->first_region > first_region)
+    {
+      other->first_region -= region_count;
+    }
+  }
+
+  PoolFree(&mega_buffer->mesh_pool, mesh);
+  mega_buffer->meshes[handle] = NULL;
+  ArrayPush(&mega_buffer->free_meshes, handle);
+}
+
+// drops every mesh in handles and loads the paths again, edited files miss
+// the cache and get re-imported. the old spans stay alive until the frames
+// that might draw them retire, so both copies need room for a moment.
+// removed back to front so the free list hands the handles out in order
+void ReloadMeshes(State *state,
+                  const char **mesh_paths,
+                  int path_count,
+                  Array<u32> *handles)
+{
+  for (u32 i = handles->count; i > 0; i--)
+  {
+    if ((*handles)[i - 1] != MEGA_BUFFER_INVALID_MESH)
+    {
+      MegaBufferRemoveMesh(&state->mega_buffer, (*handles)[i - 1]);
+    }
+  }
+  ArrayClear(handles);
+  LoadMeshes(state, mesh_paths, path_count, handles);
+}
+
+// call once the frame's fence has signaled, every frame before it has then
+// retired and spans they could read are safe to hand out again.
+// ready_ticket is the highest upload the frame's commands may read
+void MegaBufferBeginFrame(MegaBuffer *mega_buffer, u64 ready_ticket)
+{
+  mega_buffer->frame++;
+  mega_buffer->ready_ticket = ready_ticket;
+  u32 kept = 0;
+  for (u32 i = 0; i < mega_buffer->pending_frees.count; i++)
+  {
+    MegaBufferFree pending = mega_buffer->pending_frees[i];
+    if (pending.retire_frame <= mega_buffer->frame &&
+        pending.ticket <= ready_ticket)
+    {
+      vmaVirtualFree(mega_buffer->block, pending.allocation);
+    }
+    else
+    {
+      mega_buffer->pending_frees[kept++] = pending;
+    }
+  }
+  mega_buffer->pending_frees.count = kept;
+}
+
+// fragmentation is the share of free space outside the largest free range,
+// 0% means the next allocation can use all of it
+void MegaBufferDumpStats(MegaBuffer *mega_buffer, FILE *out)
+{
+  VmaDetailedStatistics stats;
+  vmaCalculateVirtualBlockStatistics(mega_buffer->block, &stats);
+  u64 used = stats.statistics.allocationBytes;
+  u64 free = mega_buffer->size - used;
+  u64 largest_free = stats.unusedRangeCount ? stats.unusedRangeSizeMax : 0;
+  double fragmentation =
+    free ? 100.0 * (1.0 - (double)largest_free / (double)free) : 0.0;
+  u32 live_meshes = mega_buffer->mesh_pool.live_count;
+  fprintf(out,
+          "mega buffer: %.1f / %.1f MB in %u spans, %u meshes, %u free ranges, "
+          "largest free %.1f MB, fragmentation %.1f%%, %u spans pending free\n",
+          used / (1024.0 * 1024.0),
+          mega_buffer->size / (1024.0 * 1024.0),
+          stats.statistics.allocationCount,
+          live_meshes,
+          stats.unusedRangeCount,
+          largest_free / (1024.0 * 1024.0),
+          fragmentation,
+          mega_buffer->pending_frees.count);
+}
+
+// binds the mega buffer's vertices once, draws use vertex offsets into it.
+// index buffers are bound per draw since regions pick their own index type
+void BindMegaBuffer(VkCommandBuffer buffer, MegaBuffer *mega_buffer)
+{
+  VkDeviceSize vertex_offset = 0;
+  vkCmdBindVertexBuffers(buffer, 0, 1, &mega_buffer->buffer, &vertex_offset);
+}
+
+// coarsest lod whose error stays under MESH_LOD_PIXEL_ERROR on screen.
+// pixels_per_unit is how many pixels one object space unit covers at the
+// mesh's distance
+static u32 SelectLod(MeshRegion *region, float pixels_per_unit)
+{
+  u32 lod = 0;
+  for (u32 i = 1; i < region->lod_count; i++)
+  {
+    if (region->lods[i].error * pixels_per_unit > MESH_LOD_PIXEL_ERROR)
+    {
+      break;
+    }
+    lod = i;
+  }
+  return lod;
+}
+
+// draws every primitive of a mesh, its regions are contiguous so this is one
+// pass with no rebinding. the mesh's dequantization is folded into the mvp so
+// compact positions cost nothing extra in the shader. each region picks its
+// own lod from pixels_per_unit, see SelectLod. meshes whose upload hasn't
+// been acquired yet are skipped
+void DrawMesh(VkCommandBuffer buffer,
+              VkPipelineLayout layout,
+              MegaBuffer *mega_buffer,
+              u32 mesh_index,
+              HMM_Mat4 mvp,
+              float pixels_per_unit)
+{
+  Mesh *mesh = mega_buffer->meshes[mesh_index];
+  // removed, or still in flight on the transfer queue
+  if (mesh == NULL || mesh->ticket > mega_buffer->ready_ticket)
+  {
+    return;
+  }
+  HMM_Mat4 dequantize = HMM_MulM4(HMM_Translate(mesh->position_min),
+                                  HMM_Scale(mesh->position_scale));
+  HMM_Mat4 mesh_mvp = HMM_MulM4(mvp, dequantize);
+  vkCmdPushConstants(buffer,
+                     layout,
+                     VK_SHADER_STAGE_VERTEX_BIT,
+                     0,
+                     sizeof(HMM_Mat4),
+                     &mesh_mvp);
+  VkIndexType bound_index_type = VK_INDEX_TYPE_MAX_ENUM;
+  for (u32 i = 0; i < mesh->region_count; i++)
+  {
+    MeshRegion *region = &mega_buffer->regions[mesh->first_region + i];
+    // a mesh's primitives usually share a type so this binds once per mesh.
+    // index offsets count from the start of the buffer in either type
+    if (region->index_type != bound_index_type)
+    {
+      bound_index_type = region->index_type;
+      vkCmdBindIndexBuffer(buffer, mega_buffer->buffer, 0, bound_index_type);
+    }
+    MeshLod *lod = &region->lods[SelectLod(region, pixels_per_unit)];
+    vkCmdDrawIndexed(buffer,
+                     lod->index_count,
+                     1,
+                     lod->index_offset,
+                     (int32_t)region->vertex_offset,
+                     0);
+  }
+}
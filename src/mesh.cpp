@@ -1,26 +1,121 @@
 #include "headers.h"
 
-// create mega buffer
-//     load each .glb file
+// load meshes
+//     load each .glb file (or its cooked cache)
 //     separate vertex and index data
-//     copy all vertex data then all index data to staging buffer
-//     transfer staging buffer to gpu only memory
+//     nothing here touches the gpu, LoadMeshes in mega_buffer.cpp hands the
+//     results to the mega buffer so the offline cooker can share this file
 //
-struct RawMesh
+// returns the accessor as a tightly packed float stream. tightly packed float
+// views are read in place, anything else (strided, normalized ints, sparse)
+// gets unpacked into scratch in one call
+static const float *unpack_float_stream(Arena *scratch,
+                                        cgltf_accessor *accessor,
+                                        u32 components)
 {
-  Vertex *vertices;
-  u32 *indices;
-  u32 vertex_count;
-  u32 index_count;
-};
+  cgltf_size element_size = sizeof(float) * components;
+  if (accessor->component_type == cgltf_component_type_r_32f &&
+      !accessor->normalized && !accessor->is_sparse &&
+      accessor->buffer_view != NULL &&
+      cgltf_num_components(accessor->type) == components &&
+      (accessor->stride == 0 || accessor->stride == element_size))
+  {
+    const u8 *data = cgltf_buffer_view_data(accessor->buffer_view);
+    if (data != NULL && ((u64)(data + accessor->offset) & 3) == 0)
+    {
+      return (const float *)(data + accessor->offset);
+    }
+  }
 
-// each mesh has vertex and index data
-//
-void extract_mesh(RawMesh *raw_mesh, Arena *scratch, cgltf_mesh *mesh_data)
+  cgltf_size float_count = accessor->count * components;
+  float *floats = PushArrayNoZero<float>(scratch, float_count);
+  cgltf_accessor_unpack_floats(accessor, floats, float_count);
+  return floats;
+}
+
+// widens tightly packed u16 / copies u32 index views directly, everything
+// else goes through cgltf's unpacker
+static void unpack_indices(u32 *out, cgltf_accessor *accessor)
 {
-  // get the first primitive
-  cgltf_primitive *primitive = &mesh_data->primitives[0];
+  u32 count = (u32)accessor->count;
+  const u8 *data = accessor->buffer_view && !accessor->is_sparse
+                     ? cgltf_buffer_view_data(accessor->buffer_view)
+                     : NULL;
+  if (data != NULL)
+  {
+    data += accessor->offset;
+    if (accessor->component_type == cgltf_component_type_r_32u &&
+        (accessor->stride == 0 || accessor->stride == 4))
+    {
+      memcpy(out, data, sizeof(u32) * count);
+      return;
+    }
+    if (accessor->component_type == cgltf_component_type_r_16u &&
+        (accessor->stride == 0 || accessor->stride == 2))
+    {
+      const u16 *in = (const u16 *)data;
+      u32 i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+      __m128i zero = _mm_setzero_si128();
+      for (; i + 8 <= count; i += 8)
+      {
+        __m128i wide = _mm_loadu_si128((const __m128i *)(in + i));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi16(wide, zero));
+        _mm_storeu_si128((__m128i *)(out + i + 4),
+                         _mm_unpackhi_epi16(wide, zero));
+      }
+#endif
+      for (; i < count; i++)
+      {
+        out[i] = in[i];
+      }
+      return;
+    }
+  }
+  cgltf_accessor_unpack_indices(accessor, out, sizeof(u32), count);
+}
 
+// packs separate position / normal / uv streams into Vertex. every vertex is
+// two 16 byte halves, (px py pz nx) and (ny nz u v)
+static void interleave_vertices(Vertex *out,
+                                const float *positions,
+                                const float *normals,
+                                const float *uvs,
+                                u32 count)
+{
+  u32 i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+  // the 4 wide loads read one float past each vertex, leave the last one to
+  // the scalar loop so we never touch memory past the streams
+  for (; i + 1 < count; i++)
+  {
+    __m128 p = _mm_loadu_ps(positions + 3 * i);
+    __m128 n = _mm_loadu_ps(normals + 3 * i);
+    __m128 t = _mm_castpd_ps(_mm_load_sd((const double *)(uvs + 2 * i)));
+    // (pz pz nx nx)
+    __m128 z_nx = _mm_shuffle_ps(p, n, _MM_SHUFFLE(0, 0, 2, 2));
+    __m128 lo = _mm_shuffle_ps(p, z_nx, _MM_SHUFFLE(2, 0, 1, 0));
+    __m128 hi = _mm_shuffle_ps(n, t, _MM_SHUFFLE(1, 0, 2, 1));
+    _mm_storeu_ps(&out[i].x, lo);
+    _mm_storeu_ps(&out[i].ny, hi);
+  }
+#endif
+  for (; i < count; i++)
+  {
+    out[i] = {
+      positions[3 * i + 0], positions[3 * i + 1], positions[3 * i + 2],
+      normals[3 * i + 0],   normals[3 * i + 1],   normals[3 * i + 2],
+      uvs[2 * i + 0],       uvs[2 * i + 1],
+    };
+  }
+}
+
+// each primitive has its own vertex and index data
+//
+void extract_primitive(RawMesh *raw_mesh,
+                       Arena *arena,
+                       cgltf_primitive *primitive)
+{
   cgltf_accessor *position_accessor = NULL;
   cgltf_accessor *normal_accessor = NULL;
   cgltf_accessor *uv_accessor = NULL;
@@ -36,7 +131,8 @@ void extract_mesh(RawMesh *raw_mesh, Arena *scratch, cgltf_mesh *mesh_data)
     {
       normal_accessor = attribute->data;
     }
-    if (attribute->type == cgltf_attribute_type_texcoord)
+    if (attribute->type == cgltf_attribute_type_texcoord &&
+        attribute->index == 0)
     {
       uv_accessor = attribute->data;
     }
@@ -47,246 +143,168 @@ void extract_mesh(RawMesh *raw_mesh, Arena *scratch, cgltf_mesh *mesh_data)
     err("data has no positon attribute");
   }
 
+  // streams that need unpacking live in scratch until they're interleaved
+  ArenaTemp temp = GetScratch(&arena, 1);
+
   u32 vertex_count = (u32)position_accessor->count;
   raw_mesh->vertex_count = vertex_count;
-  raw_mesh->vertices =
-    (Vertex *)ArenaPush(scratch, sizeof(Vertex) * vertex_count);
-
-  // extract positions
-  for (u32 i = 0; i < vertex_count; i++)
-  {
-    float tmp[3];
-    cgltf_accessor_read_float(position_accessor, i, tmp, 3);
-    raw_mesh->vertices[i].x = tmp[0];
-    raw_mesh->vertices[i].y = tmp[1];
-    raw_mesh->vertices[i].z = tmp[2];
-  }
-
-  // extract normals
-  if (normal_accessor)
-  {
-    for (u32 i = 0; i < vertex_count; i++)
-    {
-      float tmp[3];
-      cgltf_accessor_read_float(normal_accessor, i, tmp, 3);
-      raw_mesh->vertices[i].nx = tmp[0];
-      raw_mesh->vertices[i].ny = tmp[1];
-      raw_mesh->vertices[i].nz = tmp[2];
-    }
-  }
-
-  // extract uvs
-  if (uv_accessor)
-  {
-    for (u32 i = 0; i < vertex_count; i++)
-    {
-      float tmp[3];
-      cgltf_accessor_read_float(uv_accessor, i, tmp, 2);
-      raw_mesh->vertices[i].u = tmp[0];
-      raw_mesh->vertices[i].v = tmp[1];
-    }
-  }
+  // every field is written below, skip zeroing the whole array
+  raw_mesh->vertices = PushArrayNoZero<Vertex>(arena, vertex_count);
+
+  const float *positions =
+    unpack_float_stream(temp.arena, position_accessor, 3);
+  // missing attributes read as zero
+  const float *normals = normal_accessor
+                           ? unpack_float_stream(temp.arena, normal_accessor, 3)
+                           : PushArray<float>(temp.arena, 3 * vertex_count);
+  const float *uvs = uv_accessor
+                       ? unpack_float_stream(temp.arena, uv_accessor, 2)
+                       : PushArray<float>(temp.arena, 2 * vertex_count);
+
+  interleave_vertices(
+    raw_mesh->vertices, positions, normals, uvs, vertex_count);
+  ReleaseScratch(temp);
 
   // extract indices
   if (primitive->indices)
   {
     u32 index_count = (u32)primitive->indices->count;
-    raw_mesh->indices = (u32 *)ArenaPush(scratch, sizeof(u32) * index_count);
+    raw_mesh->indices = PushArrayNoZero<u32>(arena, index_count);
     raw_mesh->index_count = index_count;
-    for (u32 i = 0; i < index_count; i++)
-    {
-      raw_mesh->indices[i] =
-        (u32)cgltf_accessor_read_index(primitive->indices, i);
-    }
+    unpack_indices(raw_mesh->indices, primitive->indices);
   }
   else
   {
     // generate sequential indices
     u32 index_count = vertex_count;
-    raw_mesh->indices = (u32 *)ArenaPush(scratch, sizeof(u32) * index_count);
+    raw_mesh->indices = PushArrayNoZero<u32>(arena, index_count);
     raw_mesh->index_count = index_count;
     for (u32 i = 0; i < index_count; i++)
     {
       raw_mesh->indices[i] = i;
     }
   }
-  debug("extracted mesh!");
+  raw_mesh->lod_count = 1;
+  raw_mesh->lods[0] = { 0, raw_mesh->index_count, 0.0f };
+  // welding and lods only drop vertices, so these stay conservative
+  ComputeMeshBounds(raw_mesh);
+  debug("extracted primitive!");
+}
+
+// cgltf allocations go straight into the worker's scratch arena and are all
+// dropped at once when the file is done, so free is a no-op
+static void *cgltf_arena_alloc(void *user, cgltf_size size)
+{
+  return ArenaPushNoZero((Arena *)user, size);
 }
 
-void CreateMegaBuffer(State *state, const char **mesh_paths, int path_count)
+static void cgltf_arena_free(void *user, void *ptr)
 {
-  Arena *scratch = &state->scratch_arena;
-  MegaBuffer *mega_buffer = &state->mega_buffer;
+  (void)user;
+  (void)ptr;
+}
 
-  RawMesh *raw_meshes =
-    (RawMesh *)ArenaPush(scratch, sizeof(RawMesh) * MAX_MESHES);
+void InitMeshLoadJob(MeshLoadJob *job)
+{
+  job->arena = ArenaReserve(gigabytes(1), g_scratch_arena_flags);
+  job->primitives = ArrayInit<RawMesh>(&job->arena, 4);
+  job->mesh_primitive_counts = ArrayInit<u32>(&job->arena, 4);
+  job->meshlets = ArrayInit<Meshlet>(&job->arena, 0);
+  job->meshlet_vertices = ArrayInit<u32>(&job->arena, 0);
+  job->meshlet_triangles = ArrayInit<u8>(&job->arena, 0);
+  job->primitive_meshlet_counts = ArrayInit<u32>(&job->arena, 4);
+}
 
-  int current_mesh = 0;
+void ReleaseMeshLoadJob(MeshLoadJob *job)
+{
+  UnmapFile(&job->cache);
+  ArenaRelease(&job->arena);
+}
 
-  for (int i = 0; i < path_count; i++)
+// parses the glTF file and extracts every triangle primitive into the job
+void ParseMeshFile(MeshLoadJob *job)
+{
+  ArenaTemp temp = GetScratch(NULL, 0);
+  cgltf_options options = {};
+  options.memory.alloc_func = cgltf_arena_alloc;
+  options.memory.free_func = cgltf_arena_free;
+  options.memory.user_data = temp.arena;
+  cgltf_data *data = NULL;
+
+  cgltf_result parse_result = cgltf_parse_file(&options, job->path, &data);
+  if (parse_result != cgltf_result_success)
   {
-    cgltf_options options = {};
-    cgltf_data *data = NULL;
-
-    cgltf_result parse_result =
-      cgltf_parse_file(&options, mesh_paths[i], &data);
-    if (parse_result != cgltf_result_success)
-    {
-      err("could not parse mesh file at %s", mesh_paths[i]);
-    }
-    cgltf_result buffer_result = cgltf_load_buffers(&options, data, NULL);
-    if (buffer_result != cgltf_result_success)
-    {
-      err("could not load buffers from file at %s", mesh_paths[i]);
-    }
+    err("could not parse mesh file at %s", job->path);
+  }
+  cgltf_result buffer_result = cgltf_load_buffers(&options, data, job->path);
+  if (buffer_result != cgltf_result_success)
+  {
+    err("could not load buffers from file at %s", job->path);
+  }
 
-    cgltf_mesh *meshes = data->meshes;
-    int meshes_count = (int)data->meshes_count;
-    for (int j = 0; j < meshes_count; j++)
+  cgltf_mesh *meshes = data->meshes;
+  int meshes_count = (int)data->meshes_count;
+  for (int j = 0; j < meshes_count; j++)
+  {
+    u32 primitive_count = 0;
+    for (cgltf_size k = 0; k < meshes[j].primitives_count; k++)
     {
-      if (current_mesh >= MAX_MESHES)
+      cgltf_primitive *primitive = &meshes[j].primitives[k];
+      // the pipeline only draws triangle lists
+      if (primitive->type != cgltf_primitive_type_triangles)
       {
-        err("exceeded max meshes %d", MAX_MESHES);
+        debug("skipping non triangle primitive %zu of mesh %d in %s",
+              (size_t)k,
+              j,
+              job->path);
+        continue;
       }
-      extract_mesh(&raw_meshes[current_mesh], scratch, &meshes[j]);
-      current_mesh++;
+      extract_primitive(ArrayPush(&job->primitives), &job->arena, primitive);
+      primitive_count++;
+    }
+    if (primitive_count > 0)
+    {
+      ArrayPush(&job->mesh_primitive_counts, primitive_count);
     }
-    cgltf_free(data);
   }
+  ReleaseScratch(temp);
+}
 
-  // now all our raw mesh data is stored in a scratch arena
-  //
-  //  transition from scratch arena to staging area
-  int total_meshes = current_mesh;
-  u64 total_vertex_bytes = 0;
-  u64 total_index_bytes = 0;
-  for (int i = 0; i < total_meshes; i++)
+// clusters every primitive's full detail level, the cache stores the result
+// so warm loads never run this
+void BuildMeshFileMeshlets(MeshLoadJob *job)
+{
+  for (u32 i = 0; i < job->primitives.count; i++)
   {
-    total_vertex_bytes += sizeof(Vertex) * raw_meshes[i].vertex_count;
-    total_index_bytes += sizeof(u32) * raw_meshes[i].index_count;
+    RawMesh lod = RawMeshLod(&job->primitives[i], 0);
+    u32 meshlet_count = BuildMeshlets(&lod,
+                                      &job->meshlets,
+                                      &job->meshlet_vertices,
+                                      &job->meshlet_triangles);
+    ArrayPush(&job->primitive_meshlet_counts, meshlet_count);
   }
+}
 
-  u64 vertex_region_start = 0;
-  // align to 16 bytes TODO(Nate): understand why this works
-  u64 index_region_start = (total_vertex_bytes + 15) & ~(u64)15;
-  u64 total_bytes = total_index_bytes + total_vertex_bytes;
-
-  mega_buffer->vertex_region_offset = vertex_region_start;
-  mega_buffer->index_region_offset = index_region_start;
-
-  VkBufferCreateInfo staging_info = {
-    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-    .size = total_bytes,
-    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-  };
-
-  VmaAllocationCreateInfo staging_alloc_info = {
-    .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
-    .usage = VMA_MEMORY_USAGE_CPU_ONLY,
-  };
-
-  VkBuffer staging_buffer;
-  VmaAllocation staging_allocation;
-  VmaAllocationInfo staging_result = {};
-  validate(vmaCreateBuffer(state->context->allocator,
-                           &staging_info,
-                           &staging_alloc_info,
-                           &staging_buffer,
-                           &staging_allocation,
-                           &staging_result),
-           "could not allocate staging buffer");
-
-  // memcpy from cpu to staging buffer
-  u8 *base = (u8 *)staging_result.pMappedData;
-  u32 vertex_position = 0;
-  u32 index_position = 0;
+static void LoadMeshFile(void *user, u32 index)
+{
+  MeshLoadJob *job = &((MeshLoadJob *)user)[index];
+  InitMeshLoadJob(job);
 
-  // memcpy from scratch arena into staging buffer
-  for (int i = 0; i < total_meshes; i++)
+  if (!LoadMeshCache(job, g_mesh_process_flags))
   {
-    MeshRegion *region = &mega_buffer->regions[i];
-    mega_buffer->mesh_count += 1;
-
-    region->vertex_offset = vertex_position;
-    region->index_offset = index_position;
-
-    region->vertex_count = raw_meshes[i].vertex_count;
-    region->index_count = raw_meshes[i].index_count;
-
-    memcpy(base + vertex_region_start + vertex_position * sizeof(Vertex),
-           raw_meshes[i].vertices,
-           sizeof(Vertex) * raw_meshes[i].vertex_count);
-
-    memcpy(base + index_region_start + index_position * sizeof(u32),
-           raw_meshes[i].indices,
-           sizeof(u32) * raw_meshes[i].index_count);
-
-    vertex_position += raw_meshes[i].vertex_count;
-    index_position += raw_meshes[i].index_count;
+    ParseMeshFile(job);
+    for (u32 i = 0; i < job->primitives.count; i++)
+    {
+      ProcessMesh(&job->primitives[i], &job->arena, g_mesh_process_flags);
+    }
+    BuildMeshFileMeshlets(job);
+    WriteMeshCache(job, index, g_mesh_process_flags);
   }
+}
 
-  // create device local gpu memory for mega buffer
-  VkBufferCreateInfo mega_buffer_info = {
-    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-    .size = total_bytes,
-    .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-             VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
-             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-  };
-
-  VmaAllocationCreateInfo mega_alloc_info = {
-    .usage = VMA_MEMORY_USAGE_GPU_ONLY,
-  };
-
-  validate(vmaCreateBuffer(state->context->allocator,
-                           &mega_buffer_info,
-                           &mega_alloc_info,
-                           &mega_buffer->buffer,
-                           &mega_buffer->allocation,
-                           NULL),
-           "could not create mega buffer on gpu");
-
-  //  transition from stagin area to gpu read only VRAM
-  VkCommandBufferAllocateInfo command_buffer_alloc_info = {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-    .commandPool = state->context->frame_context[0].command_pool,
-    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-    .commandBufferCount = 1,
-  };
-
-  VkCommandBuffer buffer;
-  vkAllocateCommandBuffers(
-    state->context->device, &command_buffer_alloc_info, &buffer);
-
-  VkCommandBufferBeginInfo begin_info = {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-  };
-
-  vkBeginCommandBuffer(buffer, &begin_info);
-
-  VkBufferCopy region = { 0, 0, total_bytes };
-  vkCmdCopyBuffer(buffer, staging_buffer, mega_buffer->buffer, 1, &region);
-  vkEndCommandBuffer(buffer);
-
-  VkSubmitInfo submit = {
-    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-    .commandBufferCount = 1,
-    .pCommandBuffers = &buffer,
-  };
-
-  vkQueueSubmit(state->context->queue, 1, &submit, VK_NULL_HANDLE);
-  vkQueueWaitIdle(state->context->queue);
-
-  vkFreeCommandBuffers(state->context->device,
-                       state->context->frame_context[0].command_pool,
-                       1,
-                       &buffer);
-
-  vmaDestroyBuffer(
-    state->context->allocator, staging_buffer, staging_allocation);
-
-  ArenaReset(scratch);
-  debug("created mega buffer");
+// loads or imports every file on the worker pool, each job ends up with its
+// primitives and meshlets ready to go into the mega buffer
+void LoadMeshFiles(MeshLoadJob *jobs, u32 job_count)
+{
+  ParallelFor(job_count, LoadMeshFile, jobs);
 }
@@ -0,0 +1,652 @@
+#include "headers.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#undef CreateWindow
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// cooked mesh cache
+//     one file per source asset, written next to it as <path>.mcache
+//     header, per mesh primitive counts, primitive table, then the vertex,
+//     index, meshlet, meshlet vertex and meshlet triangle blobs at 16 byte
+//     aligned offsets
+//     every cache is mapped and stays mapped until its meshes are uploaded.
+//     raw caches have RawMesh point straight into them, so the only copy left
+//     is the write into the staging ring. packed caches (the default) go
+//     through mesh_codec.cpp and are decoded straight into the staging ring
+//     while uploading, trading a fast decode for a much smaller read on cold
+//     starts. meshlets are always stored raw and used in place
+//     a cache belongs to its source's contents, not its file stamp: a copy or
+//     checkout that only touches the stamp costs a hash of the source, and a
+//     cache whose source isn't there at all is used as is
+//
+#define MESH_CACHE_MAGIC 0x4348534d // "MSHC"
+#define MESH_CACHE_VERSION 8
+#define MESH_CACHE_EXTENSION ".mcache"
+// indices decoded at a time when range checking a packed stream
+#define MESH_CACHE_CHECK_CHUNK (16 * MESH_CODEC_BLOCK)
+
+int g_mesh_cache_enabled = 1;
+u32 g_mesh_cache_codec = MESH_CACHE_CODEC_PACKED;
+
+struct MeshCacheHeader
+{
+  u32 magic;
+  u32 version;
+  u32 vertex_size;
+  u32 mesh_count;
+  u32 primitive_count;
+  // MeshProcessFlags the data went through
+  u32 process_flags;
+  float weld_epsilon;
+  // MeshCacheCodec of the vertex and index blobs
+  u32 codec;
+  u32 meshlet_size;
+  u32 meshlet_count;
+  // source file stamp, the cache is stale if the size changes. a changed
+  // modify time only means stale when the content hash changed too
+  u64 source_size;
+  SDL_Time source_modify_time;
+  u64 source_hash;
+  u64 vertex_blob_offset;
+  u64 vertex_blob_size;
+  u64 index_blob_offset;
+  u64 index_blob_size;
+  // meshlet_count meshlets, their offsets index the other two blobs
+  u64 meshlet_blob_offset;
+  u64 meshlet_vertex_blob_offset;
+  u64 meshlet_vertex_blob_size;
+  u64 meshlet_triangle_blob_offset;
+  u64 meshlet_triangle_blob_size;
+};
+
+struct MeshCachePrimitive
+{
+  // byte ranges inside the vertex and index blobs
+  u64 vertex_data_offset;
+  u64 vertex_data_size;
+  u64 index_data_offset;
+  u64 index_data_size;
+  u32 vertex_count;
+  u32 index_count;
+  // the primitive's meshlets follow the previous primitive's
+  u32 meshlet_count;
+  // lod index ranges are relative to the primitive's indices
+  u32 lod_count;
+  MeshLod lods[MESH_MAX_LODS];
+  MeshBounds bounds;
+};
+
+bool MapFile(const char *path, MappedFile *file)
+{
+  *file = {};
+#if defined(_WIN32)
+  HANDLE handle = CreateFileA(path,
+                              GENERIC_READ,
+                              FILE_SHARE_READ,
+                              NULL,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              NULL);
+  if (handle == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+  {
+    CloseHandle(handle);
+    return false;
+  }
+  HANDLE mapping =
+    CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(handle);
+  if (mapping == NULL)
+  {
+    return false;
+  }
+  file->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  file->size = (u64)size.QuadPart;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0)
+  {
+    close(fd);
+    return false;
+  }
+  void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  file->data = data == MAP_FAILED ? NULL : data;
+  file->size = (u64)info.st_size;
+#endif
+  return file->data != NULL;
+}
+
+void UnmapFile(MappedFile *file)
+{
+  if (file->data == NULL)
+  {
+    return;
+  }
+#if defined(_WIN32)
+  UnmapViewOfFile(file->data);
+#else
+  munmap(file->data, file->size);
+#endif
+  *file = {};
+}
+
+static void MeshCachePath(char *out, u64 out_size, const char *path)
+{
+  snprintf(out, out_size, "%s%s", path, MESH_CACHE_EXTENSION);
+}
+
+// hash of the source file's bytes, 0 when it can't be read
+static u64 MeshCacheSourceHash(const char *path)
+{
+  MappedFile source;
+  if (!MapFile(path, &source))
+  {
+    return 0;
+  }
+  u64 hash = HashBytes(source.data, source.size);
+  UnmapFile(&source);
+  return hash;
+}
+
+// [offset, offset + size) inside [0, limit) without overflowing
+static bool RangeFits(u64 offset, u64 size, u64 limit)
+{
+  return size <= limit && offset <= limit - size;
+}
+
+// everything the loader hands on is indexed with these counts, so a table
+// entry has to be self consistent before any of it is used
+static bool MeshCachePrimitiveValid(const MeshCachePrimitive *entry,
+                                    const MeshCacheHeader *header)
+{
+  if (!RangeFits(entry->vertex_data_offset,
+                 entry->vertex_data_size,
+                 header->vertex_blob_size) ||
+      !RangeFits(entry->index_data_offset,
+                 entry->index_data_size,
+                 header->index_blob_size))
+  {
+    return false;
+  }
+  if (header->codec == MESH_CACHE_CODEC_RAW &&
+      (entry->vertex_data_size != sizeof(Vertex) * (u64)entry->vertex_count ||
+       entry->index_data_size != sizeof(u32) * (u64)entry->index_count))
+  {
+    return false;
+  }
+  // packed indices are clamped to the last vertex, there has to be one
+  if (entry->lod_count == 0 || entry->lod_count > MESH_MAX_LODS ||
+      (entry->index_count > 0 && entry->vertex_count == 0))
+  {
+    return false;
+  }
+  for (u32 k = 0; k < entry->lod_count; k++)
+  {
+    if (!RangeFits(entry->lods[k].index_offset,
+                   entry->lods[k].index_count,
+                   entry->index_count))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool IndicesInRange(const u32 *indices, u32 count, u32 vertex_count)
+{
+  u32 out_of_range = 0;
+  for (u32 i = 0; i < count; i++)
+  {
+    out_of_range |= indices[i] >= vertex_count;
+  }
+  return out_of_range == 0;
+}
+
+// packed index values only show up once decoded, so the stream is decoded
+// here a chunk at a time and held to the same rule as a raw cache's indices
+static bool PackedIndicesInRange(const u8 *data,
+                                 u64 size,
+                                 u32 count,
+                                 u32 vertex_count)
+{
+  ArenaTemp temp = GetScratch(NULL, 0);
+  u32 *indices = PushArrayNoZero<u32>(temp.arena, MESH_CACHE_CHECK_CHUNK);
+  MeshCodecReader reader;
+  MeshCodecReaderInit(&reader, data, size);
+  bool clamped = false;
+  bool valid = true;
+  for (u32 first = 0; first < count && valid; first += MESH_CACHE_CHECK_CHUNK)
+  {
+    u32 n = SDL_min(count - first, MESH_CACHE_CHECK_CHUNK);
+    valid = DecodeIndexBlocks(&reader, indices, n, UINT32_MAX, &clamped) &&
+            IndicesInRange(indices, n, vertex_count);
+  }
+  ReleaseScratch(temp);
+  return valid;
+}
+
+// meshlets sit back to back in primitive order with contiguous vertex and
+// triangle runs, the layout BuildMeshlets produces and MegaBufferAddMeshes
+// relies on. every meshlet vertex has to be one of its primitive's vertices
+// and every triangle corner one of its meshlet's vertices
+static bool MeshCacheMeshletsValid(const MeshCacheHeader *header,
+                                   const MeshCachePrimitive *table,
+                                   const Meshlet *meshlets,
+                                   const u32 *meshlet_vertices,
+                                   const u8 *meshlet_triangles)
+{
+  u64 vertex_total = header->meshlet_vertex_blob_size / sizeof(u32);
+  u64 triangle_total = header->meshlet_triangle_blob_size;
+  u64 next_meshlet = 0;
+  u64 next_vertex = 0;
+  u64 next_triangle = 0;
+  for (u32 i = 0; i < header->primitive_count; i++)
+  {
+    const MeshCachePrimitive *entry = &table[i];
+    if (entry->meshlet_count > header->meshlet_count - next_meshlet)
+    {
+      return false;
+    }
+    for (u32 m = 0; m < entry->meshlet_count; m++)
+    {
+      const Meshlet *meshlet = &meshlets[next_meshlet++];
+      u64 corner_count = (u64)meshlet->triangle_count * 3;
+      if (meshlet->vertex_offset != next_vertex ||
+          meshlet->triangle_offset != next_triangle ||
+          meshlet->vertex_count > MESHLET_MAX_VERTICES ||
+          meshlet->triangle_count > MESHLET_MAX_TRIANGLES ||
+          meshlet->vertex_count > vertex_total - next_vertex ||
+          corner_count > triangle_total - next_triangle)
+      {
+        return false;
+      }
+      u32 out_of_range = 0;
+      for (u32 v = 0; v < meshlet->vertex_count; v++)
+      {
+        out_of_range |=
+          meshlet_vertices[next_vertex + v] >= entry->vertex_count;
+      }
+      for (u64 c = 0; c < corner_count; c++)
+      {
+        out_of_range |=
+          meshlet_triangles[next_triangle + c] >= meshlet->vertex_count;
+      }
+      if (out_of_range)
+      {
+        return false;
+      }
+      next_vertex += meshlet->vertex_count;
+      next_triangle += corner_count;
+    }
+  }
+  return next_meshlet == header->meshlet_count &&
+         next_vertex == vertex_total && next_triangle == triangle_total;
+}
+
+// array over a blob of the mapping. it never has spare capacity, so pushing
+// onto it copies it into the arena and the mapping is never written
+template <typename T>
+static Array<T> MeshCacheArray(Arena *arena, u8 *data, u64 count)
+{
+  Array<T> array = {
+    .arena = arena,
+    .data = (T *)data,
+    .count = (u32)count,
+    .capacity = (u32)count,
+  };
+  return array;
+}
+
+// maps the cache for the job's path if it exists, matches the source file and
+// went through at least process_flags, fills in the job's primitives and
+// meshlets. they all point into the mapping, which has to outlive them.
+// packed primitives only get their streams, the upload decodes them. every
+// count, range and index is checked first, packed streams are walked to make
+// sure they decode and their indices are decoded once to range check them. a
+// cache that doesn't add up is a miss and the caller re-imports the source
+bool LoadMeshCache(MeshLoadJob *job, u32 process_flags)
+{
+  if (!g_mesh_cache_enabled)
+  {
+    return false;
+  }
+  SDL_PathInfo source;
+  bool has_source = SDL_GetPathInfo(job->path, &source);
+
+  char cache_path[1024];
+  MeshCachePath(cache_path, sizeof(cache_path), job->path);
+  MappedFile *file = &job->cache;
+  if (!MapFile(cache_path, file))
+  {
+    return false;
+  }
+
+  u8 *base = (u8 *)file->data;
+  MeshCacheHeader *header = (MeshCacheHeader *)base;
+  if (file->size < sizeof(MeshCacheHeader))
+  {
+    UnmapFile(file);
+    return false;
+  }
+  u64 tables_end = sizeof(MeshCacheHeader) +
+                   sizeof(u32) * (u64)header->mesh_count +
+                   sizeof(MeshCachePrimitive) * (u64)header->primitive_count;
+  if (header->magic != MESH_CACHE_MAGIC ||
+      header->version != MESH_CACHE_VERSION ||
+      header->vertex_size != sizeof(Vertex) ||
+      header->meshlet_size != sizeof(Meshlet) ||
+      (header->codec != MESH_CACHE_CODEC_RAW &&
+       header->codec != MESH_CACHE_CODEC_PACKED) ||
+      (header->process_flags & process_flags) != process_flags ||
+      ((process_flags & MESH_PROCESS_WELD) &&
+       header->weld_epsilon != g_weld_epsilon) ||
+      tables_end > file->size ||
+      !RangeFits(
+        header->vertex_blob_offset, header->vertex_blob_size, file->size) ||
+      !RangeFits(
+        header->index_blob_offset, header->index_blob_size, file->size) ||
+      !RangeFits(header->meshlet_blob_offset,
+                 sizeof(Meshlet) * (u64)header->meshlet_count,
+                 file->size) ||
+      !RangeFits(header->meshlet_vertex_blob_offset,
+                 header->meshlet_vertex_blob_size,
+                 file->size) ||
+      !RangeFits(header->meshlet_triangle_blob_offset,
+                 header->meshlet_triangle_blob_size,
+                 file->size) ||
+      header->meshlet_vertex_blob_size % sizeof(u32) != 0 ||
+      header->meshlet_vertex_blob_size / sizeof(u32) > UINT32_MAX ||
+      header->meshlet_triangle_blob_size > UINT32_MAX)
+  {
+    debug("stale or invalid mesh cache %s", cache_path);
+    UnmapFile(file);
+    return false;
+  }
+
+  // the stamp of a copied or checked out source changes while its bytes
+  // don't, the hash settles it then
+  if (has_source &&
+      (header->source_size != source.size ||
+       (header->source_modify_time != source.modify_time &&
+        header->source_hash != MeshCacheSourceHash(job->path))))
+  {
+    debug("stale mesh cache %s", cache_path);
+    UnmapFile(file);
+    return false;
+  }
+  if (!has_source)
+  {
+    debug("no source next to %s, using it as is", cache_path);
+  }
+
+  u32 *counts = (u32 *)(base + sizeof(MeshCacheHeader));
+  MeshCachePrimitive *table =
+    (MeshCachePrimitive *)(counts + header->mesh_count);
+  u8 *vertex_blob = base + header->vertex_blob_offset;
+  u8 *index_blob = base + header->index_blob_offset;
+  u8 *meshlet_blob = base + header->meshlet_blob_offset;
+  u8 *meshlet_vertex_blob = base + header->meshlet_vertex_blob_offset;
+  u8 *meshlet_triangle_blob = base + header->meshlet_triangle_blob_offset;
+  u64 meshlet_vertex_count = header->meshlet_vertex_blob_size / sizeof(u32);
+  bool packed = header->codec == MESH_CACHE_CODEC_PACKED;
+  // meshes own consecutive runs of primitives and must use up the table
+  u64 counted_primitives = 0;
+  bool valid = true;
+  for (u32 i = 0; i < header->mesh_count && valid; i++)
+  {
+    valid = counts[i] > 0;
+    counted_primitives += counts[i];
+  }
+  valid = valid && counted_primitives == header->primitive_count;
+  for (u32 i = 0; i < header->primitive_count && valid; i++)
+  {
+    MeshCachePrimitive *entry = &table[i];
+    u8 *vertex_data = vertex_blob + entry->vertex_data_offset;
+    u8 *index_data = index_blob + entry->index_data_offset;
+    valid = MeshCachePrimitiveValid(entry, header) &&
+            (packed ? MeshCodecStreamValid(entry->vertex_count,
+                                           sizeof(Vertex),
+                                           vertex_data,
+                                           entry->vertex_data_size) &&
+                        MeshCodecStreamValid(entry->index_count,
+                                             sizeof(u32),
+                                             index_data,
+                                             entry->index_data_size) &&
+                        PackedIndicesInRange(index_data,
+                                             entry->index_data_size,
+                                             entry->index_count,
+                                             entry->vertex_count)
+                    : IndicesInRange((u32 *)index_data,
+                                     entry->index_count,
+                                     entry->vertex_count));
+  }
+  valid = valid && MeshCacheMeshletsValid(header,
+                                          table,
+                                          (Meshlet *)meshlet_blob,
+                                          (u32 *)meshlet_vertex_blob,
+                                          meshlet_triangle_blob);
+  if (!valid)
+  {
+    debug("corrupt mesh cache %s", cache_path);
+    UnmapFile(file);
+    return false;
+  }
+
+  for (u32 i = 0; i < header->primitive_count; i++)
+  {
+    MeshCachePrimitive *entry = &table[i];
+    RawMesh *raw_mesh = ArrayPush(&job->primitives);
+    raw_mesh->vertex_count = entry->vertex_count;
+    raw_mesh->index_count = entry->index_count;
+    raw_mesh->lod_count = entry->lod_count;
+    memcpy(raw_mesh->lods, entry->lods, sizeof(raw_mesh->lods));
+    raw_mesh->bounds = entry->bounds;
+    ArrayPush(&job->primitive_meshlet_counts, entry->meshlet_count);
+    u8 *vertex_data = vertex_blob + entry->vertex_data_offset;
+    u8 *index_data = index_blob + entry->index_data_offset;
+    if (packed)
+    {
+      raw_mesh->packed_vertices = vertex_data;
+      raw_mesh->packed_indices = index_data;
+      raw_mesh->packed_vertex_size = entry->vertex_data_size;
+      raw_mesh->packed_index_size = entry->index_data_size;
+    }
+    else
+    {
+      raw_mesh->vertices = (Vertex *)vertex_data;
+      raw_mesh->indices = (u32 *)index_data;
+    }
+  }
+
+  for (u32 i = 0; i < header->mesh_count; i++)
+  {
+    ArrayPush(&job->mesh_primitive_counts, counts[i]);
+  }
+  Arena *arena = &job->arena;
+  job->meshlets =
+    MeshCacheArray<Meshlet>(arena, meshlet_blob, header->meshlet_count);
+  job->meshlet_vertices =
+    MeshCacheArray<u32>(arena, meshlet_vertex_blob, meshlet_vertex_count);
+  job->meshlet_triangles = MeshCacheArray<u8>(
+    arena, meshlet_triangle_blob, header->meshlet_triangle_blob_size);
+  debug("loaded %s mesh cache %s (%.1f KB)",
+        packed ? "packed" : "raw",
+        cache_path,
+        file->size / 1024.0);
+  return true;
+}
+
+static void WritePadding(FILE *file, u64 *position, u64 alignment)
+{
+  static const u8 zeros[16] = {};
+  u64 aligned = ForwardAlign(*position, alignment);
+  fwrite(zeros, 1, aligned - *position, file);
+  *position = aligned;
+}
+
+// written to a temporary name and renamed into place so a crash or a second
+// writer never leaves a half written cache behind. returns the file size, 0
+// when nothing was written
+u64 WriteMeshCache(MeshLoadJob *job, u32 writer_id, u32 process_flags)
+{
+  SDL_PathInfo source;
+  if (!g_mesh_cache_enabled || !SDL_GetPathInfo(job->path, &source))
+  {
+    return 0;
+  }
+
+  char cache_path[1024];
+  char temp_path[1040];
+  MeshCachePath(cache_path, sizeof(cache_path), job->path);
+  snprintf(temp_path, sizeof(temp_path), "%s.%u.tmp", cache_path, writer_id);
+
+  FILE *file = fopen(temp_path, "wb");
+  if (file == NULL)
+  {
+    debug("could not write mesh cache %s", temp_path);
+    return 0;
+  }
+
+  Array<RawMesh> *primitives = &job->primitives;
+  Array<u32> *mesh_primitive_counts = &job->mesh_primitive_counts;
+  MeshCacheHeader header = {
+    .magic = MESH_CACHE_MAGIC,
+    .version = MESH_CACHE_VERSION,
+    .vertex_size = sizeof(Vertex),
+    .mesh_count = mesh_primitive_counts->count,
+    .primitive_count = primitives->count,
+    .process_flags = process_flags,
+    .weld_epsilon = g_weld_epsilon,
+    .codec = g_mesh_cache_codec,
+    .meshlet_size = sizeof(Meshlet),
+    .meshlet_count = job->meshlets.count,
+    .source_size = source.size,
+    .source_modify_time = source.modify_time,
+    .source_hash = MeshCacheSourceHash(job->path),
+  };
+
+  // packed blobs are encoded up front, their sizes go in the table
+  ArenaTemp temp = GetScratch(NULL, 0);
+  bool packed = g_mesh_cache_codec == MESH_CACHE_CODEC_PACKED;
+  MeshCachePrimitive *table =
+    PushArray<MeshCachePrimitive>(temp.arena, primitives->count);
+  u8 **vertex_data = PushArray<u8 *>(temp.arena, primitives->count);
+  u8 **index_data = PushArray<u8 *>(temp.arena, primitives->count);
+  for (u32 i = 0; i < primitives->count; i++)
+  {
+    RawMesh *raw_mesh = &(*primitives)[i];
+    MeshCachePrimitive *entry = &table[i];
+    entry->vertex_data_offset = header.vertex_blob_size;
+    entry->index_data_offset = header.index_blob_size;
+    entry->vertex_count = raw_mesh->vertex_count;
+    entry->index_count = raw_mesh->index_count;
+    entry->lod_count = raw_mesh->lod_count;
+    memcpy(entry->lods, raw_mesh->lods, sizeof(entry->lods));
+    entry->bounds = raw_mesh->bounds;
+    entry->meshlet_count = job->primitive_meshlet_counts[i];
+    if (packed)
+    {
+      vertex_data[i] = PushArrayNoZero<u8>(
+        temp.arena, MeshCodecBound(raw_mesh->vertex_count, sizeof(Vertex)));
+      entry->vertex_data_size = EncodeVertexStream(
+        vertex_data[i], raw_mesh->vertices, raw_mesh->vertex_count);
+      index_data[i] = PushArrayNoZero<u8>(
+        temp.arena, MeshCodecBound(raw_mesh->index_count, sizeof(u32)));
+      entry->index_data_size = EncodeIndexStream(
+        index_data[i], raw_mesh->indices, raw_mesh->index_count);
+    }
+    else
+    {
+      vertex_data[i] = (u8 *)raw_mesh->vertices;
+      entry->vertex_data_size = sizeof(Vertex) * (u64)raw_mesh->vertex_count;
+      index_data[i] = (u8 *)raw_mesh->indices;
+      entry->index_data_size = sizeof(u32) * (u64)raw_mesh->index_count;
+    }
+    header.vertex_blob_size += entry->vertex_data_size;
+    header.index_blob_size += entry->index_data_size;
+  }
+
+  u64 tables_end = sizeof(MeshCacheHeader) +
+                   sizeof(u32) * (u64)header.mesh_count +
+                   sizeof(MeshCachePrimitive) * (u64)header.primitive_count;
+  header.vertex_blob_offset = ForwardAlign(tables_end, 16);
+  header.index_blob_offset =
+    ForwardAlign(header.vertex_blob_offset + header.vertex_blob_size, 16);
+  header.meshlet_blob_offset =
+    ForwardAlign(header.index_blob_offset + header.index_blob_size, 16);
+  header.meshlet_vertex_blob_offset = ForwardAlign(
+    header.meshlet_blob_offset + sizeof(Meshlet) * (u64)header.meshlet_count,
+    16);
+  header.meshlet_vertex_blob_size = sizeof(u32) * job->meshlet_vertices.count;
+  header.meshlet_triangle_blob_offset = ForwardAlign(
+    header.meshlet_vertex_blob_offset + header.meshlet_vertex_blob_size, 16);
+  header.meshlet_triangle_blob_size = job->meshlet_triangles.count;
+
+  u64 position = 0;
+  position += fwrite(&header, 1, sizeof(header), file);
+  position += fwrite(mesh_primitive_counts->data,
+                     1,
+                     sizeof(u32) * mesh_primitive_counts->count,
+                     file);
+  position +=
+    fwrite(table, 1, sizeof(MeshCachePrimitive) * primitives->count, file);
+
+  WritePadding(file, &position, 16);
+  for (u32 i = 0; i < primitives->count; i++)
+  {
+    position += fwrite(vertex_data[i], 1, table[i].vertex_data_size, file);
+  }
+
+  WritePadding(file, &position, 16);
+  for (u32 i = 0; i < primitives->count; i++)
+  {
+    position += fwrite(index_data[i], 1, table[i].index_data_size, file);
+  }
+  ReleaseScratch(temp);
+
+  // meshlets are small next to the vertex data, always raw
+  WritePadding(file, &position, 16);
+  position += fwrite(
+    job->meshlets.data, 1, sizeof(Meshlet) * job->meshlets.count, file);
+  WritePadding(file, &position, 16);
+  position += fwrite(job->meshlet_vertices.data,
+                     1,
+                     header.meshlet_vertex_blob_size,
+                     file);
+  WritePadding(file, &position, 16);
+  position += fwrite(job->meshlet_triangles.data,
+                     1,
+                     header.meshlet_triangle_blob_size,
+                     file);
+
+  bool ok = position == header.meshlet_triangle_blob_offset +
+                          header.meshlet_triangle_blob_size;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || !SDL_RenamePath(temp_path, cache_path))
+  {
+    debug("could not write mesh cache %s", cache_path);
+    SDL_RemovePath(temp_path);
+    return 0;
+  }
+  debug("wrote mesh cache %s (%.1f KB)", cache_path, position / 1024.0);
+  return position;
+}
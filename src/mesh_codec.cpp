@@ -0,0 +1,474 @@
+#include "headers.h"
+
+// mesh stream codec
+//     lossless packing for the cooked cache. streams are cut into blocks of
+//     MESH_CODEC_BLOCK elements and every block is stored as byte planes, one
+//     plane per byte of the element, so bytes that barely change end up next
+//     to each other
+//     vertices: each byte is delta coded against the same byte of the
+//     previous vertex, then zigzagged so small steps either way stay small
+//     indices: each index is delta coded against the previous one as a 32 bit
+//     value and zigzagged, the planes are its bytes
+//     planes are written as groups of 16 bytes behind a 2 bit mode per group,
+//     0 for all zero, then 2 bit, 4 bit or raw 8 bit values
+//     the decoder unpacks groups, undoes the deltas with prefix sums and
+//     transposes planes back into elements, all 16 bytes at a time. it
+//     resumes at any block boundary and never reads its output back, so the
+//     uploader decodes straight into the staging ring
+//
+
+#define MESH_CODEC_GROUP 16
+#define MESH_CODEC_GROUPS (MESH_CODEC_BLOCK / MESH_CODEC_GROUP)
+#define MESH_CODEC_VERTEX_PLANES ((u32)sizeof(Vertex))
+#define MESH_CODEC_INDEX_PLANES ((u32)sizeof(u32))
+
+static const u32 mesh_codec_group_size[4] = { 0, 4, 8, 16 };
+
+// worst case is every group raw plus the mode bytes
+u64 MeshCodecBound(u32 count, u32 stride)
+{
+  u64 bound = 0;
+  for (u32 first = 0; first < count; first += MESH_CODEC_BLOCK)
+  {
+    u32 n = SDL_min(count - first, MESH_CODEC_BLOCK);
+    u32 groups = (n + MESH_CODEC_GROUP - 1) / MESH_CODEC_GROUP;
+    bound += (u64)stride * ((groups + 3) / 4 + groups * MESH_CODEC_GROUP);
+  }
+  return bound;
+}
+
+// writes one plane of a block, groups past n read as zero
+static u8 *EncodePlane(u8 *out, const u8 *plane, u32 n)
+{
+  u32 groups = (n + MESH_CODEC_GROUP - 1) / MESH_CODEC_GROUP;
+  u8 *modes = out;
+  memset(modes, 0, (groups + 3) / 4);
+  out += (groups + 3) / 4;
+  for (u32 g = 0; g < groups; g++)
+  {
+    const u8 *group = plane + g * MESH_CODEC_GROUP;
+    u8 largest = 0;
+    for (u32 i = 0; i < MESH_CODEC_GROUP; i++)
+    {
+      largest = group[i] > largest ? group[i] : largest;
+    }
+    u32 mode = largest == 0 ? 0 : largest < 4 ? 1 : largest < 16 ? 2 : 3;
+    modes[g / 4] |= (u8)(mode << ((g % 4) * 2));
+    if (mode == 1)
+    {
+      for (u32 i = 0; i < 4; i++)
+      {
+        *out++ = (u8)(group[4 * i] | group[4 * i + 1] << 2 |
+                      group[4 * i + 2] << 4 | group[4 * i + 3] << 6);
+      }
+    }
+    else if (mode == 2)
+    {
+      for (u32 i = 0; i < 8; i++)
+      {
+        *out++ = (u8)(group[2 * i] | group[2 * i + 1] << 4);
+      }
+    }
+    else if (mode == 3)
+    {
+      memcpy(out, group, MESH_CODEC_GROUP);
+      out += MESH_CODEC_GROUP;
+    }
+  }
+  return out;
+}
+
+static u8 ZigZag8(u8 delta)
+{
+  return (u8)((delta << 1) ^ (u8)((int8_t)delta >> 7));
+}
+
+u64 EncodeVertexStream(u8 *out, const Vertex *vertices, u32 count)
+{
+  u8 *start = out;
+  const u8 *bytes = (const u8 *)vertices;
+  u8 previous[MESH_CODEC_VERTEX_PLANES] = {};
+  u8 planes[MESH_CODEC_VERTEX_PLANES][MESH_CODEC_BLOCK];
+  for (u32 first = 0; first < count; first += MESH_CODEC_BLOCK)
+  {
+    u32 n = SDL_min(count - first, MESH_CODEC_BLOCK);
+    memset(planes, 0, sizeof(planes));
+    for (u32 i = 0; i < n; i++)
+    {
+      const u8 *vertex = bytes + (u64)(first + i) * sizeof(Vertex);
+      for (u32 k = 0; k < MESH_CODEC_VERTEX_PLANES; k++)
+      {
+        planes[k][i] = ZigZag8((u8)(vertex[k] - previous[k]));
+        previous[k] = vertex[k];
+      }
+    }
+    for (u32 k = 0; k < MESH_CODEC_VERTEX_PLANES; k++)
+    {
+      out = EncodePlane(out, planes[k], n);
+    }
+  }
+  return (u64)(out - start);
+}
+
+u64 EncodeIndexStream(u8 *out, const u32 *indices, u32 count)
+{
+  u8 *start = out;
+  u32 previous = 0;
+  u8 planes[MESH_CODEC_INDEX_PLANES][MESH_CODEC_BLOCK];
+  for (u32 first = 0; first < count; first += MESH_CODEC_BLOCK)
+  {
+    u32 n = SDL_min(count - first, MESH_CODEC_BLOCK);
+    memset(planes, 0, sizeof(planes));
+    for (u32 i = 0; i < n; i++)
+    {
+      u32 delta = indices[first + i] - previous;
+      u32 zigzag = (delta << 1) ^ (u32)((int32_t)delta >> 31);
+      previous = indices[first + i];
+      for (u32 k = 0; k < MESH_CODEC_INDEX_PLANES; k++)
+      {
+        planes[k][i] = (u8)(zigzag >> (8 * k));
+      }
+    }
+    for (u32 k = 0; k < MESH_CODEC_INDEX_PLANES; k++)
+    {
+      out = EncodePlane(out, planes[k], n);
+    }
+  }
+  return (u64)(out - start);
+}
+
+// expands one group into 16 bytes
+static void DecodeGroup(u8 *out, const u8 *in, u32 mode)
+{
+#if defined(__SSE2__) || defined(_M_X64)
+  __m128i result;
+  if (mode == 0)
+  {
+    result = _mm_setzero_si128();
+  }
+  else if (mode == 1)
+  {
+    // four fields per byte, split them apart then interleave back in order
+    int packed;
+    memcpy(&packed, in, sizeof(packed));
+    __m128i bits = _mm_cvtsi32_si128(packed);
+    __m128i mask = _mm_set1_epi8(3);
+    __m128i f0 = _mm_and_si128(bits, mask);
+    __m128i f1 = _mm_and_si128(_mm_srli_epi16(bits, 2), mask);
+    __m128i f2 = _mm_and_si128(_mm_srli_epi16(bits, 4), mask);
+    __m128i f3 = _mm_and_si128(_mm_srli_epi16(bits, 6), mask);
+    result = _mm_unpacklo_epi16(_mm_unpacklo_epi8(f0, f1),
+                                _mm_unpacklo_epi8(f2, f3));
+  }
+  else if (mode == 2)
+  {
+    __m128i bits = _mm_loadl_epi64((const __m128i *)in);
+    __m128i mask = _mm_set1_epi8(15);
+    result = _mm_unpacklo_epi8(_mm_and_si128(bits, mask),
+                               _mm_and_si128(_mm_srli_epi16(bits, 4), mask));
+  }
+  else
+  {
+    result = _mm_loadu_si128((const __m128i *)in);
+  }
+  _mm_storeu_si128((__m128i *)out, result);
+#else
+  u32 bits = mode == 1 ? 2 : 4;
+  u32 per_byte = 8 / bits;
+  for (u32 i = 0; i < MESH_CODEC_GROUP; i++)
+  {
+    if (mode == 0)
+    {
+      out[i] = 0;
+    }
+    else if (mode == 3)
+    {
+      out[i] = in[i];
+    }
+    else
+    {
+      out[i] =
+        (in[i / per_byte] >> ((i % per_byte) * bits)) & ((1 << bits) - 1);
+    }
+  }
+#endif
+}
+
+// reads one plane of a block, zero filled to a whole number of groups.
+// returns NULL when the data runs out
+static const u8 *DecodePlane(u8 *plane, u32 n, const u8 *in, const u8 *end)
+{
+  u32 groups = (n + MESH_CODEC_GROUP - 1) / MESH_CODEC_GROUP;
+  u32 mode_bytes = (groups + 3) / 4;
+  if ((u64)(end - in) < mode_bytes)
+  {
+    return NULL;
+  }
+  const u8 *modes = in;
+  in += mode_bytes;
+  // check the whole plane once so the groups can read freely
+  u64 payload = 0;
+  for (u32 g = 0; g < groups; g++)
+  {
+    payload += mesh_codec_group_size[(modes[g / 4] >> ((g % 4) * 2)) & 3];
+  }
+  if ((u64)(end - in) < payload)
+  {
+    return NULL;
+  }
+  for (u32 g = 0; g < groups; g++)
+  {
+    u32 mode = (modes[g / 4] >> ((g % 4) * 2)) & 3;
+    DecodeGroup(plane + g * MESH_CODEC_GROUP, in, mode);
+    in += mesh_codec_group_size[mode];
+  }
+  return in;
+}
+
+// undoes zigzag and the byte deltas of a plane in place, previous carries the
+// last byte from one block to the next
+static void UndoByteDeltas(u8 *plane, u32 n, u8 *previous)
+{
+  u32 i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+  __m128i carry = _mm_set1_epi8((char)*previous);
+  __m128i one = _mm_set1_epi8(1);
+  __m128i low_bits = _mm_set1_epi8(0x7f);
+  for (; i + MESH_CODEC_GROUP <= n; i += MESH_CODEC_GROUP)
+  {
+    __m128i zigzag = _mm_loadu_si128((const __m128i *)(plane + i));
+    __m128i sign =
+      _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(zigzag, one));
+    __m128i x =
+      _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(zigzag, 1), low_bits), sign);
+    // inclusive prefix sum across the 16 lanes
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+    x = _mm_add_epi8(x, carry);
+    _mm_storeu_si128((__m128i *)(plane + i), x);
+    carry = _mm_set1_epi8((char)(_mm_extract_epi16(x, 7) >> 8));
+  }
+  *previous = (u8)_mm_cvtsi128_si32(carry);
+#endif
+  for (; i < n; i++)
+  {
+    u8 zigzag = plane[i];
+    *previous = (u8)(*previous + ((zigzag >> 1) ^ (u8)-(zigzag & 1)));
+    plane[i] = *previous;
+  }
+}
+
+// rebuilds 16 u32 values from the matching group of 4 byte planes
+#if defined(__SSE2__) || defined(_M_X64)
+static void GatherWords(__m128i *words, u8 planes[][MESH_CODEC_BLOCK], u32 i)
+{
+  __m128i b0 = _mm_loadu_si128((const __m128i *)(planes[0] + i));
+  __m128i b1 = _mm_loadu_si128((const __m128i *)(planes[1] + i));
+  __m128i b2 = _mm_loadu_si128((const __m128i *)(planes[2] + i));
+  __m128i b3 = _mm_loadu_si128((const __m128i *)(planes[3] + i));
+  __m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+  __m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+  __m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+  __m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+  words[0] = _mm_unpacklo_epi16(lo01, lo23);
+  words[1] = _mm_unpackhi_epi16(lo01, lo23);
+  words[2] = _mm_unpacklo_epi16(hi01, hi23);
+  words[3] = _mm_unpackhi_epi16(hi01, hi23);
+}
+#endif
+
+// walks the mode bytes of a stream without decoding it, true when every plane
+// of every block is there and the stream ends exactly at size. a checked
+// stream can't run the decoder out of data later
+bool MeshCodecStreamValid(u32 count, u32 stride, const u8 *data, u64 size)
+{
+  const u8 *in = data;
+  const u8 *end = data + size;
+  for (u32 first = 0; first < count; first += MESH_CODEC_BLOCK)
+  {
+    u32 n = SDL_min(count - first, MESH_CODEC_BLOCK);
+    u32 groups = (n + MESH_CODEC_GROUP - 1) / MESH_CODEC_GROUP;
+    u32 mode_bytes = (groups + 3) / 4;
+    for (u32 k = 0; k < stride; k++)
+    {
+      if ((u64)(end - in) < mode_bytes)
+      {
+        return false;
+      }
+      u64 payload = 0;
+      for (u32 g = 0; g < groups; g++)
+      {
+        payload += mesh_codec_group_size[(in[g / 4] >> ((g % 4) * 2)) & 3];
+      }
+      in += mode_bytes;
+      if ((u64)(end - in) < payload)
+      {
+        return false;
+      }
+      in += payload;
+    }
+  }
+  return in == end;
+}
+
+void MeshCodecReaderInit(MeshCodecReader *reader, const u8 *data, u64 size)
+{
+  *reader = {};
+  reader->in = data;
+  reader->end = data + size;
+}
+
+// decodes the next count vertices of the stream. count has to be a whole
+// number of blocks except on the last call. returns false when the data runs
+// out, out is then only partly written
+bool DecodeVertexBlocks(MeshCodecReader *reader, Vertex *out, u32 count)
+{
+  const u8 *in = reader->in;
+  u8 *previous = reader->previous_vertex;
+  alignas(16) u8 planes[MESH_CODEC_VERTEX_PLANES][MESH_CODEC_BLOCK];
+#if defined(__SSE2__) || defined(_M_X64)
+  // the block as 8 columns of 32 bit attributes, then transposed into out
+  alignas(16) u32 columns[MESH_CODEC_VERTEX_PLANES / 4][MESH_CODEC_BLOCK];
+#endif
+  for (u32 first = 0; first < count; first += MESH_CODEC_BLOCK)
+  {
+    u32 n = SDL_min(count - first, MESH_CODEC_BLOCK);
+    for (u32 k = 0; k < MESH_CODEC_VERTEX_PLANES; k++)
+    {
+      in = DecodePlane(planes[k], n, in, reader->end);
+      if (in == NULL)
+      {
+        return false;
+      }
+      UndoByteDeltas(planes[k], n, &previous[k]);
+    }
+
+    // only ever stores into out, it may be write combined staging memory
+    Vertex *block = out + first;
+    u32 i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    u32 padded = (n + MESH_CODEC_GROUP - 1) & ~(MESH_CODEC_GROUP - 1);
+    for (u32 c = 0; c < MESH_CODEC_VERTEX_PLANES / 4; c++)
+    {
+      for (u32 g = 0; g < padded; g += MESH_CODEC_GROUP)
+      {
+        __m128i words[4];
+        GatherWords(words, &planes[4 * c], g);
+        for (u32 w = 0; w < 4; w++)
+        {
+          _mm_store_si128((__m128i *)&columns[c][g + 4 * w], words[w]);
+        }
+      }
+    }
+    // two 4x4 transposes turn 4 rows of 8 columns into 4 vertices
+    for (; i + 4 <= n; i += 4)
+    {
+      __m128 a0 = _mm_load_ps((const float *)&columns[0][i]);
+      __m128 a1 = _mm_load_ps((const float *)&columns[1][i]);
+      __m128 a2 = _mm_load_ps((const float *)&columns[2][i]);
+      __m128 a3 = _mm_load_ps((const float *)&columns[3][i]);
+      __m128 b0 = _mm_load_ps((const float *)&columns[4][i]);
+      __m128 b1 = _mm_load_ps((const float *)&columns[5][i]);
+      __m128 b2 = _mm_load_ps((const float *)&columns[6][i]);
+      __m128 b3 = _mm_load_ps((const float *)&columns[7][i]);
+      _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+      _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+      float *row = &block[i].x;
+      _mm_storeu_ps(row + 0, a0);
+      _mm_storeu_ps(row + 4, b0);
+      _mm_storeu_ps(row + 8, a1);
+      _mm_storeu_ps(row + 12, b1);
+      _mm_storeu_ps(row + 16, a2);
+      _mm_storeu_ps(row + 20, b2);
+      _mm_storeu_ps(row + 24, a3);
+      _mm_storeu_ps(row + 28, b3);
+    }
+#endif
+    for (; i < n; i++)
+    {
+      u8 vertex[MESH_CODEC_VERTEX_PLANES];
+      for (u32 k = 0; k < MESH_CODEC_VERTEX_PLANES; k++)
+      {
+        vertex[k] = planes[k][i];
+      }
+      memcpy(&block[i], vertex, sizeof(Vertex));
+    }
+  }
+  reader->in = in;
+  return true;
+}
+
+// same for indices. anything above max_index is clamped to it so a corrupt
+// stream can't index past its region, clamped is set when that happens
+bool DecodeIndexBlocks(MeshCodecReader *reader,
+                       u32 *out,
+                       u32 count,
+                       u32 max_index,
+                       bool *clamped)
+{
+  const u8 *in = reader->in;
+  u32 previous = reader->previous_index;
+  u32 over = 0;
+  alignas(16) u8 planes[MESH_CODEC_INDEX_PLANES][MESH_CODEC_BLOCK];
+  for (u32 first = 0; first < count; first += MESH_CODEC_BLOCK)
+  {
+    u32 n = SDL_min(count - first, MESH_CODEC_BLOCK);
+    for (u32 k = 0; k < MESH_CODEC_INDEX_PLANES; k++)
+    {
+      in = DecodePlane(planes[k], n, in, reader->end);
+      if (in == NULL)
+      {
+        return false;
+      }
+    }
+
+    u32 *block = out + first;
+    u32 i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128i carry = _mm_set1_epi32((int)previous);
+    __m128i one = _mm_set1_epi32(1);
+    // sse2 only compares signed, flipping the top bit orders them unsigned
+    __m128i bias = _mm_set1_epi32(INT32_MIN);
+    __m128i limit = _mm_set1_epi32((int)max_index);
+    __m128i biased_limit = _mm_xor_si128(limit, bias);
+    __m128i any_over = _mm_setzero_si128();
+    for (; i + MESH_CODEC_GROUP <= n; i += MESH_CODEC_GROUP)
+    {
+      __m128i words[4];
+      GatherWords(words, planes, i);
+      for (u32 w = 0; w < 4; w++)
+      {
+        __m128i zigzag = words[w];
+        __m128i sign =
+          _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(zigzag, one));
+        __m128i x = _mm_xor_si128(_mm_srli_epi32(zigzag, 1), sign);
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, carry);
+        carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i high =
+          _mm_cmpgt_epi32(_mm_xor_si128(x, bias), biased_limit);
+        any_over = _mm_or_si128(any_over, high);
+        x = _mm_or_si128(_mm_andnot_si128(high, x), _mm_and_si128(high, limit));
+        _mm_storeu_si128((__m128i *)(block + i + 4 * w), x);
+      }
+    }
+    previous = (u32)_mm_cvtsi128_si32(carry);
+    over |= (u32)_mm_movemask_epi8(any_over);
+#endif
+    for (; i < n; i++)
+    {
+      u32 zigzag = (u32)planes[0][i] | (u32)planes[1][i] << 8 |
+                   (u32)planes[2][i] << 16 | (u32)planes[3][i] << 24;
+      previous += (zigzag >> 1) ^ (0u - (zigzag & 1));
+      over |= previous > max_index;
+      block[i] = previous > max_index ? max_index : previous;
+    }
+  }
+  reader->in = in;
+  reader->previous_index = previous;
+  *clamped = *clamped || over != 0;
+  return true;
+}
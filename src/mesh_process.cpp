@@ -0,0 +1,664 @@
+#include "headers.h"
+
+// mesh processing stages
+//     run on RawMesh after extraction, either by the offline cooker or the
+//     runtime loader. every stage rewrites the mesh in place and keeps its
+//     temporaries in scratch
+//
+
+// vertex snapped to an epsilon grid, vertices sharing a cell weld together.
+// attributes too large for the grid or not finite keep their exact bits
+// instead, flagged in exact so they can't land in a grid cell
+struct WeldCell
+{
+  int64_t q[8];
+  u64 exact;
+};
+
+// cell indices past this would leave the int64_t range
+#define WELD_CELL_LIMIT 4.0e18
+
+static WeldCell MakeWeldCell(const Vertex &vertex, double inverse_epsilon)
+{
+  const float *f = &vertex.x;
+  WeldCell cell = {};
+  for (u32 i = 0; i < 8; i++)
+  {
+    double scaled = (double)f[i] * inverse_epsilon + 0.5;
+    // also false for nan
+    if (scaled > -WELD_CELL_LIMIT && scaled < WELD_CELL_LIMIT)
+    {
+      cell.q[i] = (int64_t)floor(scaled);
+    }
+    else
+    {
+      u32 bits;
+      memcpy(&bits, &f[i], sizeof(bits));
+      cell.q[i] = bits;
+      cell.exact |= 1ull << i;
+    }
+  }
+  return cell;
+}
+
+// single pass over the vertices with an arena hash table keyed on Key.
+// unique vertices are compacted to the front of the array, which is safe
+// since the write cursor never passes the read cursor
+template <typename Key, typename MakeKey>
+static u32 WeldWithKey(RawMesh *mesh,
+                       u32 *remap,
+                       Arena *scratch,
+                       MakeKey make_key)
+{
+  HashMap<Key, u32> unique =
+    HashMapInit<Key, u32>(scratch, mesh->vertex_count * 2);
+
+  u32 unique_count = 0;
+  for (u32 i = 0; i < mesh->vertex_count; i++)
+  {
+    Vertex vertex = mesh->vertices[i];
+    bool inserted;
+    u32 *slot =
+      HashMapGetOrPut(&unique, make_key(vertex), unique_count, &inserted);
+    remap[i] = *slot;
+    if (inserted)
+    {
+      mesh->vertices[unique_count++] = vertex;
+    }
+  }
+  return unique_count;
+}
+
+float g_weld_epsilon = 0.0f;
+
+// merges duplicate vertices and remaps the index buffer onto the survivors.
+// epsilon 0 merges bit identical vertices only, otherwise every attribute is
+// snapped to an epsilon grid and vertices landing in the same cell merge
+// into the first one seen
+void WeldVertices(RawMesh *mesh, float epsilon)
+{
+  ArenaTemp temp = GetScratch(NULL, 0);
+  u32 *remap = PushArrayNoZero<u32>(temp.arena, mesh->vertex_count);
+
+  u32 before = mesh->vertex_count;
+  u32 unique_count = 0;
+  if (epsilon > 0.0f)
+  {
+    double inverse_epsilon = 1.0 / epsilon;
+    unique_count = WeldWithKey<WeldCell>(
+      mesh, remap, temp.arena, [inverse_epsilon](const Vertex &vertex) {
+        return MakeWeldCell(vertex, inverse_epsilon);
+      });
+  }
+  else
+  {
+    unique_count = WeldWithKey<Vertex>(
+      mesh, remap, temp.arena, [](const Vertex &vertex) { return vertex; });
+  }
+
+  for (u32 i = 0; i < mesh->index_count; i++)
+  {
+    mesh->indices[i] = remap[mesh->indices[i]];
+  }
+  mesh->vertex_count = unique_count;
+
+  ReleaseScratch(temp);
+
+  debug("welded %u -> %u vertices, %.1f KB -> %.1f KB (%.1f%% smaller)",
+        before,
+        unique_count,
+        sizeof(Vertex) * before / 1024.0,
+        sizeof(Vertex) * unique_count / 1024.0,
+        before ? 100.0 * (before - unique_count) / before : 0.0);
+}
+
+// renumbers vertices in the order the index buffer first touches them so
+// vertex fetch walks memory forward, vertices nothing references are dropped
+void OptimizeVertexFetch(RawMesh *mesh)
+{
+  ArenaTemp temp = GetScratch(NULL, 0);
+
+  Vertex *original = PushArrayNoZero<Vertex>(temp.arena, mesh->vertex_count);
+  memcpy(original, mesh->vertices, sizeof(Vertex) * mesh->vertex_count);
+
+  u32 *remap = PushArrayNoZero<u32>(temp.arena, mesh->vertex_count);
+  memset(remap, 0xff, sizeof(u32) * mesh->vertex_count);
+
+  u32 next = 0;
+  for (u32 i = 0; i < mesh->index_count; i++)
+  {
+    u32 index = mesh->indices[i];
+    if (remap[index] == UINT32_MAX)
+    {
+      remap[index] = next;
+      mesh->vertices[next++] = original[index];
+    }
+    mesh->indices[i] = remap[index];
+  }
+  mesh->vertex_count = next;
+
+  ReleaseScratch(temp);
+}
+
+// simulates a FIFO post transform cache of cache_size entries
+VertexCacheStats AnalyzeVertexCache(RawMesh *mesh, u32 cache_size)
+{
+  ArenaTemp temp = GetScratch(NULL, 0);
+
+  // a vertex is resident while fewer than cache_size misses happened since
+  // it was loaded
+  u32 *loaded_at = PushArrayNoZero<u32>(temp.arena, mesh->vertex_count);
+  memset(loaded_at, 0xff, sizeof(u32) * mesh->vertex_count);
+
+  u32 misses = 0;
+  for (u32 i = 0; i < mesh->index_count; i++)
+  {
+    u32 index = mesh->indices[i];
+    if (loaded_at[index] == UINT32_MAX ||
+        misses - loaded_at[index] >= cache_size)
+    {
+      loaded_at[index] = misses++;
+    }
+  }
+  ReleaseScratch(temp);
+
+  u32 triangle_count = mesh->index_count / 3;
+  VertexCacheStats stats = {
+    .acmr = triangle_count ? (float)misses / (float)triangle_count : 0.0f,
+    .atvr =
+      mesh->vertex_count ? (float)misses / (float)mesh->vertex_count : 0.0f,
+  };
+  return stats;
+}
+
+// tipsify (Sander, Nehab, Barczak 2007). fans triangles around a focus vertex
+// and picks the next focus among the vertices just emitted, preferring ones
+// still in the cache with few triangles left. linear in the index count
+void OptimizeVertexCache(RawMesh *mesh, u32 cache_size)
+{
+  u32 vertex_count = mesh->vertex_count;
+  u32 triangle_count = mesh->index_count / 3;
+  if (triangle_count == 0)
+  {
+    return;
+  }
+
+  ArenaTemp temp = GetScratch(NULL, 0);
+  Arena *scratch = temp.arena;
+
+  // vertex -> triangle adjacency
+  u32 *live = PushArray<u32>(scratch, vertex_count);
+  u32 *adjacency_offsets = PushArrayNoZero<u32>(scratch, vertex_count + 1);
+  u32 *adjacency = PushArrayNoZero<u32>(scratch, triangle_count * 3);
+  for (u32 i = 0; i < triangle_count * 3; i++)
+  {
+    live[mesh->indices[i]]++;
+  }
+  adjacency_offsets[0] = 0;
+  for (u32 v = 0; v < vertex_count; v++)
+  {
+    adjacency_offsets[v + 1] = adjacency_offsets[v] + live[v];
+  }
+  u32 *fill = PushArrayNoZero<u32>(scratch, vertex_count);
+  memcpy(fill, adjacency_offsets, sizeof(u32) * vertex_count);
+  for (u32 t = 0; t < triangle_count; t++)
+  {
+    for (u32 k = 0; k < 3; k++)
+    {
+      adjacency[fill[mesh->indices[t * 3 + k]]++] = t;
+    }
+  }
+
+  u32 *cache_time = PushArray<u32>(scratch, vertex_count);
+  u8 *emitted = PushArray<u8>(scratch, triangle_count);
+  u32 *dead_end = PushArrayNoZero<u32>(scratch, triangle_count * 3);
+  u32 dead_end_count = 0;
+  u32 *candidates = PushArrayNoZero<u32>(scratch, triangle_count * 3);
+  u32 *output = PushArrayNoZero<u32>(scratch, triangle_count * 3);
+  u32 output_count = 0;
+
+  u32 time = cache_size + 1;
+  u32 cursor = 0;
+  int focus = 0;
+  while (focus >= 0)
+  {
+    u32 candidate_count = 0;
+    for (u32 a = adjacency_offsets[focus]; a < adjacency_offsets[focus + 1];
+         a++)
+    {
+      u32 t = adjacency[a];
+      if (emitted[t])
+      {
+        continue;
+      }
+      for (u32 k = 0; k < 3; k++)
+      {
+        u32 v = mesh->indices[t * 3 + k];
+        output[output_count++] = v;
+        dead_end[dead_end_count++] = v;
+        candidates[candidate_count++] = v;
+        live[v]--;
+        if (time - cache_time[v] > cache_size)
+        {
+          cache_time[v] = time++;
+        }
+      }
+      emitted[t] = 1;
+    }
+
+    // best candidate that will still be in the cache once its remaining
+    // triangles are emitted
+    focus = -1;
+    int best_priority = -1;
+    for (u32 i = 0; i < candidate_count; i++)
+    {
+      u32 v = candidates[i];
+      if (live[v] == 0)
+      {
+        continue;
+      }
+      int priority = 0;
+      if (time - cache_time[v] + 2 * live[v] <= cache_size)
+      {
+        priority = (int)(time - cache_time[v]);
+      }
+      if (priority > best_priority)
+      {
+        best_priority = priority;
+        focus = (int)v;
+      }
+    }
+
+    if (focus == -1)
+    {
+      // dead end, try recently emitted vertices first, then scan forward
+      while (dead_end_count > 0)
+      {
+        u32 v = dead_end[--dead_end_count];
+        if (live[v] > 0)
+        {
+          focus = (int)v;
+          break;
+        }
+      }
+      while (focus == -1 && cursor < vertex_count)
+      {
+        if (live[cursor] > 0)
+        {
+          focus = (int)cursor;
+        }
+        cursor++;
+      }
+    }
+  }
+
+  memcpy(mesh->indices, output, sizeof(u32) * output_count);
+  ReleaseScratch(temp);
+}
+
+// a single lod as a mesh of its own, sharing vertices and indices with mesh
+RawMesh RawMeshLod(RawMesh *mesh, u32 lod)
+{
+  RawMesh view = *mesh;
+  view.indices = mesh->indices + mesh->lods[lod].index_offset;
+  view.index_count = mesh->lods[lod].index_count;
+  view.lod_count = 1;
+  view.lods[0] = { 0, view.index_count, 0.0f };
+  return view;
+}
+
+// bit identical welding is lossless so it's always on, lods only add index
+// ranges and leave lod 0 alone
+u32 g_mesh_process_flags = MESH_PROCESS_WELD | MESH_PROCESS_LOD;
+
+// runs the stages selected in flags in the order they depend on each other.
+// stages that grow the mesh allocate from arena
+void ProcessMesh(RawMesh *mesh, Arena *arena, u32 flags)
+{
+  if (flags & MESH_PROCESS_WELD)
+  {
+    WeldVertices(mesh, g_weld_epsilon);
+  }
+  if (flags & MESH_PROCESS_LOD)
+  {
+    GenerateLods(mesh, arena, MESH_LOD_RATIO, MESH_LOD_MAX_ERROR);
+  }
+  if (flags & MESH_PROCESS_VERTEX_CACHE)
+  {
+    for (u32 i = 0; i < mesh->lod_count; i++)
+    {
+      RawMesh lod = RawMeshLod(mesh, i);
+      VertexCacheStats before = AnalyzeVertexCache(&lod, VERTEX_CACHE_SIZE);
+      OptimizeVertexCache(&lod, VERTEX_CACHE_SIZE);
+      VertexCacheStats after = AnalyzeVertexCache(&lod, VERTEX_CACHE_SIZE);
+      debug("vertex cache lod %u: acmr %.3f -> %.3f, atvr %.3f -> %.3f",
+            i,
+            before.acmr,
+            after.acmr,
+            before.atvr,
+            after.atvr);
+    }
+  }
+  if (flags & MESH_PROCESS_VERTEX_FETCH)
+  {
+    OptimizeVertexFetch(mesh);
+  }
+}
+
+// box from ComputePositionBounds, the sphere sits at the box center and
+// reaches the farthest vertex. looser than ritter's but one simd pass
+void ComputeMeshBounds(RawMesh *mesh)
+{
+  MeshBounds *bounds = &mesh->bounds;
+  *bounds = {};
+  if (mesh->vertex_count == 0)
+  {
+    return;
+  }
+  HMM_Vec3 min = HMM_V3(INFINITY, INFINITY, INFINITY);
+  HMM_Vec3 max = HMM_V3(-INFINITY, -INFINITY, -INFINITY);
+  ComputePositionBounds(mesh, &min, &max);
+  bounds->min = min;
+  bounds->max = max;
+  bounds->center = HMM_MulV3F(HMM_AddV3(min, max), 0.5f);
+
+  HMM_Vec3 center = bounds->center;
+  float farthest = 0.0f;
+  u32 i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+  __m128 center_x = _mm_set1_ps(center.X);
+  __m128 center_y = _mm_set1_ps(center.Y);
+  __m128 center_z = _mm_set1_ps(center.Z);
+  __m128 farthest4 = _mm_setzero_ps();
+  for (; i + 4 <= mesh->vertex_count; i += 4)
+  {
+    // rows are (x y z nx), transposed the nx row is ignored
+    __m128 x = _mm_loadu_ps(&mesh->vertices[i + 0].x);
+    __m128 y = _mm_loadu_ps(&mesh->vertices[i + 1].x);
+    __m128 z = _mm_loadu_ps(&mesh->vertices[i + 2].x);
+    __m128 w = _mm_loadu_ps(&mesh->vertices[i + 3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    __m128 dx = _mm_sub_ps(x, center_x);
+    __m128 dy = _mm_sub_ps(y, center_y);
+    __m128 dz = _mm_sub_ps(z, center_z);
+    __m128 distance = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    farthest4 = _mm_max_ps(farthest4, distance);
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, farthest4);
+  farthest = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+#endif
+  for (; i < mesh->vertex_count; i++)
+  {
+    Vertex *vertex = &mesh->vertices[i];
+    HMM_Vec3 offset =
+      HMM_SubV3(HMM_V3(vertex->x, vertex->y, vertex->z), center);
+    farthest = fmaxf(farthest, HMM_DotV3(offset, offset));
+  }
+  bounds->radius = sqrtf(farthest);
+}
+
+// compact vertex quantization
+//     positions become unorm16 inside the mesh bounds, normals are folded onto
+//     an octahedron and stored as snorm16, uvs become half floats. the sse2
+//     path converts 4 vertices per iteration, the scalar path below matches it
+//
+
+u32 g_vertex_format = VERTEX_FORMAT_FLOAT;
+
+void ComputePositionBounds(RawMesh *mesh, HMM_Vec3 *min, HMM_Vec3 *max)
+{
+  if (mesh->vertex_count == 0)
+  {
+    return;
+  }
+  u32 i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+  // the w lane holds nx, it's dropped when storing the result
+  __m128 lo = _mm_setr_ps(min->X, min->Y, min->Z, 0.0f);
+  __m128 hi = _mm_setr_ps(max->X, max->Y, max->Z, 0.0f);
+  for (; i < mesh->vertex_count; i++)
+  {
+    __m128 position = _mm_loadu_ps(&mesh->vertices[i].x);
+    lo = _mm_min_ps(lo, position);
+    hi = _mm_max_ps(hi, position);
+  }
+  float lo_out[4], hi_out[4];
+  _mm_storeu_ps(lo_out, lo);
+  _mm_storeu_ps(hi_out, hi);
+  *min = HMM_V3(lo_out[0], lo_out[1], lo_out[2]);
+  *max = HMM_V3(hi_out[0], hi_out[1], hi_out[2]);
+#endif
+  for (; i < mesh->vertex_count; i++)
+  {
+    Vertex *vertex = &mesh->vertices[i];
+    *min = HMM_V3(fminf(min->X, vertex->x),
+                  fminf(min->Y, vertex->y),
+                  fminf(min->Z, vertex->z));
+    *max = HMM_V3(fmaxf(max->X, vertex->x),
+                  fmaxf(max->Y, vertex->y),
+                  fmaxf(max->Z, vertex->z));
+  }
+}
+
+// round to nearest even, overflow goes to inf and nan stays nan
+static u16 FloatToHalf(float value)
+{
+  u32 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  u32 sign = bits & 0x80000000u;
+  bits ^= sign;
+
+  u32 result;
+  if (bits >= (u32)(127 + 16) << 23)
+  {
+    result = bits > 0x7f800000u ? 0x7e00 : 0x7c00;
+  }
+  else if (bits < (u32)(127 - 14) << 23)
+  {
+    // subnormal, adding 0.5 lines the half mantissa up with the float one
+    float magnitude;
+    memcpy(&magnitude, &bits, sizeof(bits));
+    magnitude += 0.5f;
+    memcpy(&result, &magnitude, sizeof(result));
+    result -= 0x3f000000u;
+  }
+  else
+  {
+    u32 mantissa_odd = (bits >> 13) & 1;
+    bits += ((u32)(15 - 127) << 23) + 0xfff + mantissa_odd;
+    result = bits >> 13;
+  }
+  return (u16)(result | (sign >> 16));
+}
+
+static u16 QuantizeSnorm16(float value)
+{
+  value = fminf(fmaxf(value, -1.0f), 1.0f);
+  return (u16)(int16_t)lrintf(value * 32767.0f);
+}
+
+static void EncodeOctahedral(const Vertex *vertex, u16 *out_x, u16 *out_y)
+{
+  float length = fabsf(vertex->nx) + fabsf(vertex->ny) + fabsf(vertex->nz);
+  float inverse_length = length > 0.0f ? 1.0f / length : 0.0f;
+  float x = vertex->nx * inverse_length;
+  float y = vertex->ny * inverse_length;
+  if (vertex->nz < 0.0f)
+  {
+    float folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    float folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    x = folded_x;
+    y = folded_y;
+  }
+  *out_x = QuantizeSnorm16(x);
+  *out_y = QuantizeSnorm16(y);
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+// 4 lanes of FloatToHalf, results are sign extended so packs_epi32 is exact
+static __m128i FloatToHalf4(__m128 value)
+{
+  __m128i sign_mask = _mm_set1_epi32((int)0x80000000u);
+  __m128 sign = _mm_and_ps(value, _mm_castsi128_ps(sign_mask));
+  __m128 magnitude = _mm_xor_ps(value, sign);
+  __m128i bits = _mm_castps_si128(magnitude);
+
+  __m128i is_nan = _mm_castps_si128(_mm_cmpunord_ps(magnitude, magnitude));
+  __m128i is_finite = _mm_cmpgt_epi32(_mm_set1_epi32((127 + 16) << 23), bits);
+  __m128i special = _mm_or_si128(_mm_and_si128(is_nan, _mm_set1_epi32(0x200)),
+                                 _mm_set1_epi32(0x7c00));
+
+  __m128i is_subnormal =
+    _mm_cmpgt_epi32(_mm_set1_epi32((127 - 14) << 23), bits);
+  __m128i subnormal_magic = _mm_set1_epi32(0x3f000000);
+  __m128i subnormal = _mm_sub_epi32(
+    _mm_castps_si128(
+      _mm_add_ps(magnitude, _mm_castsi128_ps(subnormal_magic))),
+    subnormal_magic);
+
+  __m128i mantissa_odd = _mm_srai_epi32(_mm_slli_epi32(bits, 31 - 13), 31);
+  __m128i normal =
+    _mm_add_epi32(bits, _mm_set1_epi32(0xfff - ((127 - 15) << 23)));
+  normal = _mm_srli_epi32(_mm_sub_epi32(normal, mantissa_odd), 13);
+
+  __m128i finite = _mm_or_si128(_mm_and_si128(is_subnormal, subnormal),
+                                _mm_andnot_si128(is_subnormal, normal));
+  __m128i result = _mm_or_si128(_mm_and_si128(is_finite, finite),
+                                _mm_andnot_si128(is_finite, special));
+  return _mm_or_si128(result, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+
+// (a0 a1 a2 a3 b0 b1 b2 b3) -> (a0 b0 a1 b1 a2 b2 a3 b3)
+static __m128i InterleavePairs(__m128i packed)
+{
+  return _mm_unpacklo_epi16(packed, _mm_unpackhi_epi64(packed, packed));
+}
+#endif
+
+void QuantizeVertices(CompactVertex *out,
+                      const Vertex *in,
+                      u32 count,
+                      HMM_Vec3 position_min,
+                      HMM_Vec3 position_scale)
+{
+  // flat axes quantize to 0
+  HMM_Vec3 inverse_scale = {
+    position_scale.X > 0.0f ? 65535.0f / position_scale.X : 0.0f,
+    position_scale.Y > 0.0f ? 65535.0f / position_scale.Y : 0.0f,
+    position_scale.Z > 0.0f ? 65535.0f / position_scale.Z : 0.0f,
+  };
+
+  u32 i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+  __m128 min_x = _mm_set1_ps(position_min.X);
+  __m128 min_y = _mm_set1_ps(position_min.Y);
+  __m128 min_z = _mm_set1_ps(position_min.Z);
+  __m128 inverse_x = _mm_set1_ps(inverse_scale.X);
+  __m128 inverse_y = _mm_set1_ps(inverse_scale.Y);
+  __m128 inverse_z = _mm_set1_ps(inverse_scale.Z);
+  __m128 half = _mm_set1_ps(0.5f);
+  __m128 zero = _mm_setzero_ps();
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 unorm_max = _mm_set1_ps(65535.0f);
+  __m128 snorm_max = _mm_set1_ps(32767.0f);
+  __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000u));
+  // unorm16 goes through packs_epi32 biased by -32768, flipping the top bit
+  // afterwards undoes the bias
+  __m128i unorm_bias = _mm_set1_epi32(32768);
+  __m128i unorm_flip = _mm_set1_epi16((short)0x8000);
+
+  for (; i + 4 <= count; i += 4)
+  {
+    // transpose 4 vertices into (x y z nx) and (ny nz u v) lanes
+    __m128 x = _mm_loadu_ps(&in[i + 0].x);
+    __m128 y = _mm_loadu_ps(&in[i + 1].x);
+    __m128 z = _mm_loadu_ps(&in[i + 2].x);
+    __m128 nx = _mm_loadu_ps(&in[i + 3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, nx);
+    __m128 ny = _mm_loadu_ps(&in[i + 0].ny);
+    __m128 nz = _mm_loadu_ps(&in[i + 1].ny);
+    __m128 u = _mm_loadu_ps(&in[i + 2].ny);
+    __m128 v = _mm_loadu_ps(&in[i + 3].ny);
+    _MM_TRANSPOSE4_PS(ny, nz, u, v);
+
+    // positions
+    __m128 qx = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(x, min_x), inverse_x), half);
+    __m128 qy = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(y, min_y), inverse_y), half);
+    __m128 qz = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(z, min_z), inverse_z), half);
+    qx = _mm_min_ps(_mm_max_ps(qx, zero), unorm_max);
+    qy = _mm_min_ps(_mm_max_ps(qy, zero), unorm_max);
+    qz = _mm_min_ps(_mm_max_ps(qz, zero), unorm_max);
+    __m128i xy =
+      _mm_packs_epi32(_mm_sub_epi32(_mm_cvttps_epi32(qx), unorm_bias),
+                      _mm_sub_epi32(_mm_cvttps_epi32(qy), unorm_bias));
+    __m128i zw =
+      _mm_packs_epi32(_mm_sub_epi32(_mm_cvttps_epi32(qz), unorm_bias),
+                      _mm_sub_epi32(_mm_setzero_si128(), unorm_bias));
+    xy = _mm_xor_si128(xy, unorm_flip);
+    zw = _mm_xor_si128(zw, unorm_flip);
+
+    // octahedral normals
+    __m128 abs_x = _mm_andnot_ps(sign_mask, nx);
+    __m128 abs_y = _mm_andnot_ps(sign_mask, ny);
+    __m128 abs_z = _mm_andnot_ps(sign_mask, nz);
+    __m128 length = _mm_add_ps(_mm_add_ps(abs_x, abs_y), abs_z);
+    __m128 has_length = _mm_cmpgt_ps(length, zero);
+    __m128 inverse_length = _mm_and_ps(_mm_div_ps(one, length), has_length);
+    __m128 ox = _mm_mul_ps(nx, inverse_length);
+    __m128 oy = _mm_mul_ps(ny, inverse_length);
+    // negative unless x >= 0 like the scalar fold, so -0 folds positive
+    __m128 folded_x =
+      _mm_or_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, oy)),
+                _mm_and_ps(_mm_cmpnge_ps(ox, zero), sign_mask));
+    __m128 folded_y =
+      _mm_or_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, ox)),
+                _mm_and_ps(_mm_cmpnge_ps(oy, zero), sign_mask));
+    __m128 lower = _mm_cmplt_ps(nz, zero);
+    ox = _mm_or_ps(_mm_and_ps(lower, folded_x), _mm_andnot_ps(lower, ox));
+    oy = _mm_or_ps(_mm_and_ps(lower, folded_y), _mm_andnot_ps(lower, oy));
+    ox = _mm_min_ps(_mm_max_ps(ox, _mm_sub_ps(zero, one)), one);
+    oy = _mm_min_ps(_mm_max_ps(oy, _mm_sub_ps(zero, one)), one);
+    __m128i octahedral =
+      _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(ox, snorm_max)),
+                      _mm_cvtps_epi32(_mm_mul_ps(oy, snorm_max)));
+
+    // uvs
+    __m128i uv = _mm_packs_epi32(FloatToHalf4(u), FloatToHalf4(v));
+
+    // transpose back to one 16 byte vertex per register
+    xy = InterleavePairs(xy);
+    zw = InterleavePairs(zw);
+    octahedral = InterleavePairs(octahedral);
+    uv = InterleavePairs(uv);
+    __m128i position_lo = _mm_unpacklo_epi32(xy, zw);
+    __m128i position_hi = _mm_unpackhi_epi32(xy, zw);
+    __m128i attribute_lo = _mm_unpacklo_epi32(octahedral, uv);
+    __m128i attribute_hi = _mm_unpackhi_epi32(octahedral, uv);
+    _mm_storeu_si128((__m128i *)&out[i + 0],
+                     _mm_unpacklo_epi64(position_lo, attribute_lo));
+    _mm_storeu_si128((__m128i *)&out[i + 1],
+                     _mm_unpackhi_epi64(position_lo, attribute_lo));
+    _mm_storeu_si128((__m128i *)&out[i + 2],
+                     _mm_unpacklo_epi64(position_hi, attribute_hi));
+    _mm_storeu_si128((__m128i *)&out[i + 3],
+                     _mm_unpackhi_epi64(position_hi, attribute_hi));
+  }
+#endif
+  for (; i < count; i++)
+  {
+    const Vertex *vertex = &in[i];
+    CompactVertex *compact = &out[i];
+    float qx = (vertex->x - position_min.X) * inverse_scale.X + 0.5f;
+    float qy = (vertex->y - position_min.Y) * inverse_scale.Y + 0.5f;
+    float qz = (vertex->z - position_min.Z) * inverse_scale.Z + 0.5f;
+    compact->x = (u16)fminf(fmaxf(qx, 0.0f), 65535.0f);
+    compact->y = (u16)fminf(fmaxf(qy, 0.0f), 65535.0f);
+    compact->z = (u16)fminf(fmaxf(qz, 0.0f), 65535.0f);
+    compact->w = 0;
+    EncodeOctahedral(vertex, &compact->octahedral_x, &compact->octahedral_y);
+    compact->u = FloatToHalf(vertex->u);
+    compact->v = FloatToHalf(vertex->v);
+  }
+}
@@ -0,0 +1,237 @@
+#include "headers.h"
+
+// meshlet building
+//     splits a region's triangle list into clusters of at most
+//     MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES triangles. the
+//     scan keeps index order, so clusters come out tight when the vertex cache
+//     stage ran first. every meshlet gets a bounding sphere and a backface
+//     normal cone for cluster culling
+//
+
+// the open meshlet's vertex slot of each region vertex
+#define MESHLET_NO_SLOT 0xff
+
+static HMM_Vec3 MeshletPosition(const RawMesh *mesh,
+                                const Array<u32> *meshlet_vertices,
+                                const Meshlet *meshlet,
+                                u32 local)
+{
+  const Vertex *vertex =
+    &mesh->vertices[meshlet_vertices->data[meshlet->vertex_offset + local]];
+  return HMM_V3(vertex->x, vertex->y, vertex->z);
+}
+
+// ritter's sphere seeded with the farthest apart pair of axis extremes
+static void ComputeMeshletSphere(const RawMesh *mesh,
+                                 const Array<u32> *meshlet_vertices,
+                                 Meshlet *meshlet)
+{
+  u32 min_local[3] = { 0, 0, 0 };
+  u32 max_local[3] = { 0, 0, 0 };
+  for (u32 i = 1; i < meshlet->vertex_count; i++)
+  {
+    HMM_Vec3 p = MeshletPosition(mesh, meshlet_vertices, meshlet, i);
+    for (u32 axis = 0; axis < 3; axis++)
+    {
+      if (p.Elements[axis] <
+          MeshletPosition(mesh, meshlet_vertices, meshlet, min_local[axis])
+            .Elements[axis])
+      {
+        min_local[axis] = i;
+      }
+      if (p.Elements[axis] >
+          MeshletPosition(mesh, meshlet_vertices, meshlet, max_local[axis])
+            .Elements[axis])
+      {
+        max_local[axis] = i;
+      }
+    }
+  }
+
+  HMM_Vec3 a = {};
+  HMM_Vec3 b = {};
+  float widest = -1.0f;
+  for (u32 axis = 0; axis < 3; axis++)
+  {
+    HMM_Vec3 lo =
+      MeshletPosition(mesh, meshlet_vertices, meshlet, min_local[axis]);
+    HMM_Vec3 hi =
+      MeshletPosition(mesh, meshlet_vertices, meshlet, max_local[axis]);
+    float distance = HMM_LenSqrV3(HMM_SubV3(hi, lo));
+    if (distance > widest)
+    {
+      widest = distance;
+      a = lo;
+      b = hi;
+    }
+  }
+
+  HMM_Vec3 center = HMM_MulV3F(HMM_AddV3(a, b), 0.5f);
+  float radius = sqrtf(widest) * 0.5f;
+  // grow the sphere just enough to take in every point outside it
+  for (u32 i = 0; i < meshlet->vertex_count; i++)
+  {
+    HMM_Vec3 p = MeshletPosition(mesh, meshlet_vertices, meshlet, i);
+    float distance = HMM_LenV3(HMM_SubV3(p, center));
+    if (distance > radius)
+    {
+      float grown = (radius + distance) * 0.5f;
+      center = HMM_AddV3(
+        center,
+        HMM_MulV3F(HMM_SubV3(p, center), (grown - radius) / distance));
+      radius = grown;
+    }
+  }
+  // rounding in the steps above can leave a point a hair outside, far from
+  // the origin especially, and culling has to stay conservative
+  for (u32 i = 0; i < meshlet->vertex_count; i++)
+  {
+    HMM_Vec3 p = MeshletPosition(mesh, meshlet_vertices, meshlet, i);
+    radius = fmaxf(radius, HMM_LenV3(HMM_SubV3(p, center)));
+  }
+  meshlet->center = center;
+  meshlet->radius = radius;
+}
+
+// the cone axis is the average face normal, the cutoff comes from the normal
+// that strays furthest from it and the apex is pulled back until every
+// triangle plane faces away from it
+static void ComputeMeshletCone(const RawMesh *mesh,
+                               const Array<u32> *meshlet_vertices,
+                               const Array<u8> *meshlet_triangles,
+                               Meshlet *meshlet)
+{
+  HMM_Vec3 normals[MESHLET_MAX_TRIANGLES];
+  HMM_Vec3 corners[MESHLET_MAX_TRIANGLES];
+  u32 normal_count = 0;
+  HMM_Vec3 axis = {};
+  const u8 *triangles = meshlet_triangles->data + meshlet->triangle_offset;
+  for (u32 i = 0; i < meshlet->triangle_count; i++)
+  {
+    HMM_Vec3 p0 =
+      MeshletPosition(mesh, meshlet_vertices, meshlet, triangles[3 * i + 0]);
+    HMM_Vec3 p1 =
+      MeshletPosition(mesh, meshlet_vertices, meshlet, triangles[3 * i + 1]);
+    HMM_Vec3 p2 =
+      MeshletPosition(mesh, meshlet_vertices, meshlet, triangles[3 * i + 2]);
+    HMM_Vec3 normal = HMM_Cross(HMM_SubV3(p1, p0), HMM_SubV3(p2, p0));
+    float length = HMM_LenV3(normal);
+    // degenerate triangles are never visible so they don't widen the cone
+    if (length <= 0.0f)
+    {
+      continue;
+    }
+    normals[normal_count] = HMM_DivV3F(normal, length);
+    corners[normal_count] = p0;
+    axis = HMM_AddV3(axis, normals[normal_count]);
+    normal_count++;
+  }
+
+  meshlet->cone_apex = meshlet->center;
+  meshlet->cone_axis = HMM_V3(0, 0, 0);
+  meshlet->cone_cutoff = 1.0f;
+  float axis_length = HMM_LenV3(axis);
+  if (normal_count == 0 || axis_length <= 0.0f)
+  {
+    return;
+  }
+  axis = HMM_DivV3F(axis, axis_length);
+
+  float min_dot = 1.0f;
+  for (u32 i = 0; i < normal_count; i++)
+  {
+    min_dot = fminf(min_dot, HMM_DotV3(axis, normals[i]));
+  }
+  // a cone this wide almost never culls, keep the default of 1
+  if (min_dot <= 0.1f)
+  {
+    return;
+  }
+
+  float max_t = 0.0f;
+  for (u32 i = 0; i < normal_count; i++)
+  {
+    float t = HMM_DotV3(HMM_SubV3(meshlet->center, corners[i]), normals[i]) /
+              HMM_DotV3(axis, normals[i]);
+    max_t = fmaxf(max_t, t);
+  }
+  meshlet->cone_apex = HMM_SubV3(meshlet->center, HMM_MulV3F(axis, max_t));
+  meshlet->cone_axis = axis;
+  meshlet->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+static void FinishMeshlet(const RawMesh *mesh,
+                          Array<Meshlet> *meshlets,
+                          Array<u32> *meshlet_vertices,
+                          Array<u8> *meshlet_triangles,
+                          Meshlet *meshlet,
+                          u8 *slots)
+{
+  ComputeMeshletSphere(mesh, meshlet_vertices, meshlet);
+  ComputeMeshletCone(mesh, meshlet_vertices, meshlet_triangles, meshlet);
+  ArrayPush(meshlets, *meshlet);
+
+  for (u32 i = 0; i < meshlet->vertex_count; i++)
+  {
+    slots[meshlet_vertices->data[meshlet->vertex_offset + i]] = MESHLET_NO_SLOT;
+  }
+  *meshlet = {};
+  meshlet->vertex_offset = meshlet_vertices->count;
+  meshlet->triangle_offset = meshlet_triangles->count;
+}
+
+// appends the region's meshlets, returns how many were added
+u32 BuildMeshlets(RawMesh *mesh,
+                  Array<Meshlet> *meshlets,
+                  Array<u32> *meshlet_vertices,
+                  Array<u8> *meshlet_triangles)
+{
+  Arena *conflicts[] = {
+    meshlets->arena,
+    meshlet_vertices->arena,
+    meshlet_triangles->arena,
+  };
+  ArenaTemp temp = GetScratch(conflicts, 3);
+  u8 *slots = PushArrayNoZero<u8>(temp.arena, mesh->vertex_count);
+  memset(slots, MESHLET_NO_SLOT, mesh->vertex_count);
+
+  u32 first_meshlet = meshlets->count;
+  Meshlet meshlet = {};
+  meshlet.vertex_offset = meshlet_vertices->count;
+  meshlet.triangle_offset = meshlet_triangles->count;
+  for (u32 i = 0; i + 2 < mesh->index_count; i += 3)
+  {
+    u32 a = mesh->indices[i + 0];
+    u32 b = mesh->indices[i + 1];
+    u32 c = mesh->indices[i + 2];
+    u32 new_vertices = (slots[a] == MESHLET_NO_SLOT) +
+                       (slots[b] == MESHLET_NO_SLOT && b != a) +
+                       (slots[c] == MESHLET_NO_SLOT && c != a && c != b);
+    if (meshlet.vertex_count + new_vertices > MESHLET_MAX_VERTICES ||
+        meshlet.triangle_count == MESHLET_MAX_TRIANGLES)
+    {
+      FinishMeshlet(
+        mesh, meshlets, meshlet_vertices, meshlet_triangles, &meshlet, slots);
+    }
+
+    u32 corners[3] = { a, b, c };
+    for (u32 k = 0; k < 3; k++)
+    {
+      if (slots[corners[k]] == MESHLET_NO_SLOT)
+      {
+        slots[corners[k]] = (u8)meshlet.vertex_count++;
+        ArrayPush(meshlet_vertices, corners[k]);
+      }
+      ArrayPush(meshlet_triangles, slots[corners[k]]);
+    }
+    meshlet.triangle_count++;
+  }
+  if (meshlet.triangle_count > 0)
+  {
+    FinishMeshlet(
+      mesh, meshlets, meshlet_vertices, meshlet_triangles, &meshlet, slots);
+  }
+
+  ReleaseScratch(temp);
+  return meshlets->count - first_meshlet;
+}
@@ -73,12 +73,28 @@ void CreatePipeline(State *state)
 
   debug("created pipeline layout");
   // shader stages
+  // the vertex shader decodes octahedral normals when the format is compact
+  u32 vertex_format = state->mega_buffer.vertex_format;
+  VkSpecializationMapEntry vertex_format_entry = {
+    .constantID = 0,
+    .offset = 0,
+    .size = sizeof(u32),
+  };
+
+  VkSpecializationInfo vertex_specialization = {
+    .mapEntryCount = 1,
+    .pMapEntries = &vertex_format_entry,
+    .dataSize = sizeof(u32),
+    .pData = &vertex_format,
+  };
+
   VkPipelineShaderStageCreateInfo shader_stages[] = {
     {
       .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
       .stage = VK_SHADER_STAGE_VERTEX_BIT,
       .module = vertex_shader,
       .pName = "main",
+      .pSpecializationInfo = &vertex_specialization,
     },
     {
       .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -91,11 +107,11 @@ void CreatePipeline(State *state)
   // vertex input
   VkVertexInputBindingDescription input_binding = {
     .binding = 0,
-    .stride = sizeof(Vertex),
+    .stride = state->mega_buffer.vertex_stride,
     .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
   };
 
-  VkVertexInputAttributeDescription input_attributes[] = {
+  VkVertexInputAttributeDescription float_attributes[] = {
     {
       .location = 0,
       .binding = 0,
@@ -111,11 +127,37 @@ void CreatePipeline(State *state)
     {
       .location = 2,
       .binding = 0,
-      .format = VK_FORMAT_R32G32B32_SFLOAT,
+      .format = VK_FORMAT_R32G32_SFLOAT,
       .offset = offsetof(Vertex, u),
     },
   };
 
+  // positions come out in [0, 1], the mvp pushed per mesh scales them back
+  VkVertexInputAttributeDescription compact_attributes[] = {
+    {
+      .location = 0,
+      .binding = 0,
+      .format = VK_FORMAT_R16G16B16A16_UNORM,
+      .offset = offsetof(CompactVertex, x),
+    },
+    {
+      .location = 1,
+      .binding = 0,
+      .format = VK_FORMAT_R16G16_SNORM,
+      .offset = offsetof(CompactVertex, octahedral_x),
+    },
+    {
+      .location = 2,
+      .binding = 0,
+      .format = VK_FORMAT_R16G16_SFLOAT,
+      .offset = offsetof(CompactVertex, u),
+    },
+  };
+
+  VkVertexInputAttributeDescription *input_attributes =
+    vertex_format == VERTEX_FORMAT_COMPACT ? compact_attributes
+                                           : float_attributes;
+
   VkPipelineVertexInputStateCreateInfo vertex_state_info = {
     .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
     .vertexBindingDescriptionCount = 1,
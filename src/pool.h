@@ -0,0 +1,97 @@
+#pragma once
+
+#include "arena.h"
+#include <assert.h>
+#include <string.h>
+
+#define CACHE_LINE_SIZE 64
+#define POOL_DEFAULT_SLAB_ITEMS 64
+
+// fixed size pool layered on an arena, freed items go on an intrusive free
+// list and get handed back out before a new slab is pushed. slabs are never
+// returned to the arena, the pool's memory lives as long as the arena does
+template <typename T>
+struct Pool
+{
+  struct FreeSlot
+  {
+    FreeSlot *next;
+  };
+
+  static constexpr u64 item_align =
+    alignof(T) > alignof(FreeSlot) ? alignof(T) : alignof(FreeSlot);
+  static constexpr u64 item_stride =
+    ((sizeof(T) > sizeof(FreeSlot) ? sizeof(T) : sizeof(FreeSlot)) +
+     item_align - 1) &
+    ~(item_align - 1);
+
+  Arena *arena;
+  FreeSlot *free_list;
+  u32 slab_items;
+  u32 live_count;
+  u32 capacity;
+};
+
+template <typename T>
+Pool<T> PoolInit(Arena *arena, u32 slab_items = POOL_DEFAULT_SLAB_ITEMS)
+{
+  assert(slab_items > 0);
+  Pool<T> pool = {
+    .arena = arena,
+    .free_list = NULL,
+    .slab_items = slab_items,
+  };
+  return pool;
+}
+
+// pushes one cache line aligned slab and threads its slots onto the free list
+// back to front so allocations walk the slab in address order
+template <typename T>
+void PoolGrow(Pool<T> *pool)
+{
+  using FreeSlot = typename Pool<T>::FreeSlot;
+
+  u64 alignment = Pool<T>::item_align > CACHE_LINE_SIZE ? Pool<T>::item_align
+                                                        : CACHE_LINE_SIZE;
+  u8 *slab = (u8 *)ArenaPushAlignNoZero(
+    pool->arena, Pool<T>::item_stride * pool->slab_items, alignment);
+
+  for (u32 i = pool->slab_items; i > 0; i--)
+  {
+    FreeSlot *slot = (FreeSlot *)(slab + (i - 1) * Pool<T>::item_stride);
+    slot->next = pool->free_list;
+    pool->free_list = slot;
+  }
+  pool->capacity += pool->slab_items;
+}
+
+template <typename T>
+T *PoolAlloc(Pool<T> *pool)
+{
+  if (pool->free_list == NULL)
+  {
+    PoolGrow(pool);
+  }
+
+  typename Pool<T>::FreeSlot *slot = pool->free_list;
+  pool->free_list = slot->next;
+  pool->live_count += 1;
+
+  memset((void *)slot, 0, sizeof(T));
+  return (T *)slot;
+}
+
+template <typename T>
+void PoolFree(Pool<T> *pool, T *item)
+{
+  if (item == NULL)
+  {
+    return;
+  }
+  assert(pool->live_count > 0);
+
+  typename Pool<T>::FreeSlot *slot = (typename Pool<T>::FreeSlot *)item;
+  slot->next = pool->free_list;
+  pool->free_list = slot;
+  pool->live_count -= 1;
+}
@@ -12,6 +12,8 @@ void RenderLoop(State *state, int frame_index)
   // reset the fence
   validate(vkResetFences(state->context->device, 1, &frame->fence),
            "could not reset fence");
+  // gpu is done with this frame so its transient memory is free again
+  ArenaReset(&frame->arena);
   // reset command pool
   validate(vkResetCommandPool(state->context->device,
                               frame->command_pool,
@@ -46,6 +48,12 @@ void RenderLoop(State *state, int frame_index)
   validate(vkBeginCommandBuffer(buffer, &buffer_info),
            "could not begin command buffer");
 
+  // send off last frame's uploads in one batch, take ownership of finished
+  // ones, then spans freed that many frames ago can be handed out again
+  UploadFlush(state);
+  u64 upload_wait = UploadAcquire(state, buffer);
+  MegaBufferBeginFrame(&state->mega_buffer, state->uploader.acquired_ticket);
+
   // transition to color attachment layout
   VkImageMemoryBarrier2 color_barrier = {
     .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
@@ -136,24 +144,13 @@ void RenderLoop(State *state, int frame_index)
   vkCmdSetScissor(buffer, 0, 1, &scissor);
   // bind buffers
   // TODO(Nate): need to actually load 3D data to render to now.
-  MeshRegion *cube_mesh = &state->mega_buffer.regions[0];
-
-  VkDeviceSize vertex_offset = state->mega_buffer.vertex_region_offset +
-                               cube_mesh->vertex_offset * sizeof(Vertex);
-
-  vkCmdBindVertexBuffers(
-    buffer, 0, 1, &state->mega_buffer.buffer, &vertex_offset);
-
-  VkDeviceSize index_offset = state->mega_buffer.index_region_offset +
-                              cube_mesh->index_offset * sizeof(u32);
-
-  vkCmdBindIndexBuffer(
-    buffer, state->mega_buffer.buffer, index_offset, VK_INDEX_TYPE_UINT32);
+  BindMegaBuffer(buffer, &state->mega_buffer);
 
   // push constants for camera
-  HMM_Mat4 view =
-    HMM_LookAt_RH(HMM_V3(5, 5, -8), HMM_V3(0, 0, 0), HMM_V3(0, 1, 0));
-  HMM_Mat4 projection = HMM_Perspective_RH_ZO(HMM_AngleDeg(60.0f),
+  HMM_Vec3 eye = HMM_V3(5, 5, -8);
+  HMM_Mat4 view = HMM_LookAt_RH(eye, HMM_V3(0, 0, 0), HMM_V3(0, 1, 0));
+  float fov = HMM_AngleDeg(60.0f);
+  HMM_Mat4 projection = HMM_Perspective_RH_ZO(fov,
                                               (float)state->swapchain->width /
                                                 (float)state->swapchain->height,
                                               0.1f,
@@ -163,13 +160,20 @@ void RenderLoop(State *state, int frame_index)
   HMM_Mat4 rotate = HMM_Rotate_RH(HMM_AngleRad(angle), HMM_V3(0, 1, 0));
   HMM_Mat4 model = HMM_MulM4(HMM_Translate(HMM_V3(0, 0, 0)), rotate);
   HMM_Mat4 mvp = HMM_MulM4(HMM_MulM4(projection, view), model);
-  vkCmdPushConstants(buffer,
-                     state->context->pipeline_layout,
-                     VK_SHADER_STAGE_VERTEX_BIT,
-                     0,
-                     sizeof(HMM_Mat4),
-                     &mvp);
-  vkCmdDrawIndexed(buffer, cube_mesh->index_count, 1, 0, 0, 0);
+  // lod selection, pixels covered by one unit at the model's distance
+  float pixels_per_unit = (float)state->swapchain->height /
+                          (2.0f * HMM_TanF(fov * 0.5f) * HMM_LenV3(eye));
+  // nothing loaded or the mesh didn't fit in the mega buffer
+  if (state->mesh_handles.count > 0 &&
+      state->mesh_handles[0] != MEGA_BUFFER_INVALID_MESH)
+  {
+    DrawMesh(buffer,
+             state->context->pipeline_layout,
+             &state->mega_buffer,
+             state->mesh_handles[0],
+             mvp,
+             pixels_per_unit);
+  }
   vkCmdEndRendering(buffer);
   // end rendering
   //
@@ -203,11 +207,20 @@ void RenderLoop(State *state, int frame_index)
     .commandBuffer = buffer,
   };
 
-  // wait info
-  VkSemaphoreSubmitInfo wait_info = {
-    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
-    .semaphore = frame->begin_rendering_semaphore,
-    .stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+  // wait info, the upload timeline only when this frame acquired something
+  VkSemaphoreSubmitInfo wait_infos[2] = {
+    {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+      .semaphore = frame->begin_rendering_semaphore,
+      .stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+    },
+    {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+      .semaphore = state->uploader.timeline,
+      .value = upload_wait,
+      .stageMask = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT |
+                   VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT,
+    },
   };
 
   // signal info
@@ -219,8 +232,8 @@ void RenderLoop(State *state, int frame_index)
 
   VkSubmitInfo2 submit_info = {
     .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
-    .waitSemaphoreInfoCount = 1,
-    .pWaitSemaphoreInfos = &wait_info,
+    .waitSemaphoreInfoCount = upload_wait ? 2u : 1u,
+    .pWaitSemaphoreInfos = wait_infos,
     .commandBufferInfoCount = 1,
     .pCommandBufferInfos = &cmd_info,
     .signalSemaphoreInfoCount = 1,
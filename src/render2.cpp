@@ -13,6 +13,8 @@ void RenderLoop2(State *state, int frame_index)
            "could not reset fences");
 
   // now we know that this frame is not being rendered by the gpu
+  // so nothing it allocated from the frame arena is still in use
+  ArenaReset(&frame->arena);
 
   // reset the command pool
   validate(vkResetCommandPool(state->context->device,
@@ -1,9 +1,20 @@
 #version 450
 
 layout(location = 0) in vec4 vertex_color;
+layout(location = 1) in vec3 vertex_normal;
 layout(location = 0) out vec4 fragment_color;
 
+// fixed directional light in object space over a flat ambient term
+const vec3 LIGHT_DIRECTION = normalize(vec3(1.0, 3.0, 2.0));
+const float AMBIENT = 0.3;
+
 void main()
 {
-    fragment_color = vertex_color;
+    // interpolated normals are shortened, missing ones read zero and only
+    // get the ambient term
+    float length_squared = dot(vertex_normal, vertex_normal);
+    vec3 n = vertex_normal * inversesqrt(max(length_squared, 1e-12));
+    float diffuse = max(dot(n, LIGHT_DIRECTION), 0.0);
+    float light = AMBIENT + (1.0 - AMBIENT) * diffuse;
+    fragment_color = vec4(vertex_color.rgb * light, vertex_color.a);
 }
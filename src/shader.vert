@@ -1,4 +1,8 @@
 #version 450
+// VertexFormat, 1 is compact: unorm16 position (dequantized by the mvp),
+// octahedral snorm16 normal and half float uv
+layout(constant_id = 0) const uint VERTEX_FORMAT = 0;
+
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 uv;
@@ -8,9 +12,21 @@ layout(push_constant) uniform PushConstants {
 } pc;
 
 layout(location = 0) out vec4 vertex_color;
+layout(location = 1) out vec3 vertex_normal;
+
+vec3 decode_octahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * mix(vec2(-1.0), vec2(1.0), step(0.0, n.xy));
+    }
+    return normalize(n);
+}
 
 void main()
 {
     gl_Position = pc.mvp * vec4(pos, 1.0);
+    vertex_normal = VERTEX_FORMAT == 1 ? decode_octahedral(normal.xy) : normal;
     vertex_color = vec4(0.35, 0.15, 0.0, 1.0);
 }
@@ -0,0 +1,418 @@
+#include "headers.h"
+
+// lod generation
+//     quadric error metric simplification (Garland, Heckbert 1997) by half
+//     edge collapse. a vertex only ever moves onto a neighbour, so every lod
+//     reuses the full mesh's vertices and just needs its own indices.
+//     vertices on open edges, which are mesh borders and the attribute seams
+//     welding leaves split, are locked so silhouettes and uv layout survive.
+//     collapses run in passes over an independent set, cheapest first, and a
+//     lod is snapshotted whenever the triangle count crosses its target
+//
+
+// sum over planes of weight * (n.p + d)^2, kept as the symmetric matrix a, the
+// vector b and the constant c. weight is the summed triangle area
+struct Quadric
+{
+  float a00, a11, a22, a01, a02, a12;
+  float b0, b1, b2;
+  float c;
+  float weight;
+};
+
+static void QuadricAddTriangle(Quadric *q,
+                               HMM_Vec3 p0,
+                               HMM_Vec3 p1,
+                               HMM_Vec3 p2)
+{
+  HMM_Vec3 normal = HMM_Cross(HMM_SubV3(p1, p0), HMM_SubV3(p2, p0));
+  float length = HMM_LenV3(normal);
+  if (length <= 0.0f)
+  {
+    return;
+  }
+  normal = HMM_DivV3F(normal, length);
+  float area = length * 0.5f;
+  float d = -HMM_DotV3(normal, p0);
+
+  q->a00 += area * normal.X * normal.X;
+  q->a11 += area * normal.Y * normal.Y;
+  q->a22 += area * normal.Z * normal.Z;
+  q->a01 += area * normal.X * normal.Y;
+  q->a02 += area * normal.X * normal.Z;
+  q->a12 += area * normal.Y * normal.Z;
+  q->b0 += area * normal.X * d;
+  q->b1 += area * normal.Y * d;
+  q->b2 += area * normal.Z * d;
+  q->c += area * d * d;
+  q->weight += area;
+}
+
+static void QuadricAdd(Quadric *q, const Quadric *other)
+{
+  q->a00 += other->a00;
+  q->a11 += other->a11;
+  q->a22 += other->a22;
+  q->a01 += other->a01;
+  q->a02 += other->a02;
+  q->a12 += other->a12;
+  q->b0 += other->b0;
+  q->b1 += other->b1;
+  q->b2 += other->b2;
+  q->c += other->c;
+  q->weight += other->weight;
+}
+
+// weighted sum of squared plane distances from p
+static float QuadricEvaluate(const Quadric *q, HMM_Vec3 p)
+{
+  float x = p.X, y = p.Y, z = p.Z;
+  float result = q->a00 * x * x + q->a11 * y * y + q->a22 * z * z +
+                 2.0f * (q->a01 * x * y + q->a02 * x * z + q->a12 * y * z) +
+                 2.0f * (q->b0 * x + q->b1 * y + q->b2 * z) + q->c;
+  return fabsf(result);
+}
+
+struct Collapse
+{
+  u32 from;
+  u32 to;
+  // mean squared distance, non negative so its bits sort like a u32
+  float cost;
+};
+
+// stable lsd radix sort on the cost bits, equal costs keep scan order so the
+// result is the same on every run. three passes leave the result in temp
+static void SortCollapses(Collapse *collapses, Collapse *temp, u32 count)
+{
+  u32 histogram[3][2048] = {};
+  for (u32 i = 0; i < count; i++)
+  {
+    u32 key;
+    memcpy(&key, &collapses[i].cost, sizeof(key));
+    histogram[0][key & 2047]++;
+    histogram[1][(key >> 11) & 2047]++;
+    histogram[2][key >> 22]++;
+  }
+  for (u32 pass = 0; pass < 3; pass++)
+  {
+    u32 sum = 0;
+    for (u32 bucket = 0; bucket < 2048; bucket++)
+    {
+      u32 bucket_count = histogram[pass][bucket];
+      histogram[pass][bucket] = sum;
+      sum += bucket_count;
+    }
+    for (u32 i = 0; i < count; i++)
+    {
+      u32 key;
+      memcpy(&key, &collapses[i].cost, sizeof(key));
+      temp[histogram[pass][(key >> (11 * pass)) & 2047]++] = collapses[i];
+    }
+    Collapse *swap = collapses;
+    collapses = temp;
+    temp = swap;
+  }
+}
+
+// true when moving corner from of the triangle onto to turns it over
+static bool FlipsTriangle(const HMM_Vec3 *positions,
+                          const u32 *triangle,
+                          u32 from,
+                          u32 to)
+{
+  HMM_Vec3 corners[3];
+  HMM_Vec3 moved[3];
+  for (u32 k = 0; k < 3; k++)
+  {
+    corners[k] = positions[triangle[k]];
+    moved[k] = triangle[k] == from ? positions[to] : corners[k];
+  }
+  HMM_Vec3 before = HMM_Cross(HMM_SubV3(corners[1], corners[0]),
+                              HMM_SubV3(corners[2], corners[0]));
+  HMM_Vec3 after = HMM_Cross(HMM_SubV3(moved[1], moved[0]),
+                             HMM_SubV3(moved[2], moved[0]));
+  return HMM_DotV3(before, after) <= 0.0f;
+}
+
+// one pass of non overlapping collapses, returns the new index count.
+// max_cost is in normalized units squared, error tracks the worst cost taken
+static u32 CollapsePass(Arena *scratch,
+                        const HMM_Vec3 *positions,
+                        Quadric *quadrics,
+                        const u8 *locked,
+                        u32 vertex_count,
+                        u32 *indices,
+                        u32 index_count,
+                        u32 target_index_count,
+                        float max_cost,
+                        float *error)
+{
+  ArenaTemp temp = ArenaTempBegin(scratch);
+  u32 triangle_count = index_count / 3;
+
+  // vertex -> triangle adjacency of the current indices
+  u32 *adjacency_offsets = PushArray<u32>(scratch, vertex_count + 1);
+  u32 *adjacency = PushArrayNoZero<u32>(scratch, index_count);
+  for (u32 i = 0; i < index_count; i++)
+  {
+    adjacency_offsets[indices[i] + 1]++;
+  }
+  for (u32 v = 0; v < vertex_count; v++)
+  {
+    adjacency_offsets[v + 1] += adjacency_offsets[v];
+  }
+  u32 *fill = PushArrayNoZero<u32>(scratch, vertex_count);
+  memcpy(fill, adjacency_offsets, sizeof(u32) * vertex_count);
+  for (u32 i = 0; i < index_count; i++)
+  {
+    adjacency[fill[indices[i]]++] = i / 3;
+  }
+
+  // every edge once per direction, from whichever triangle has it low to high
+  Collapse *collapses = PushArrayNoZero<Collapse>(scratch, index_count * 2);
+  u32 collapse_count = 0;
+  for (u32 t = 0; t < triangle_count; t++)
+  {
+    for (u32 k = 0; k < 3; k++)
+    {
+      u32 a = indices[t * 3 + k];
+      u32 b = indices[t * 3 + (k + 1) % 3];
+      if (a >= b)
+      {
+        continue;
+      }
+      Quadric merged = quadrics[a];
+      QuadricAdd(&merged, &quadrics[b]);
+      float weight = merged.weight > 0.0f ? merged.weight : 1.0f;
+      if (!locked[a])
+      {
+        collapses[collapse_count++] = {
+          a, b, QuadricEvaluate(&merged, positions[b]) / weight
+        };
+      }
+      if (!locked[b])
+      {
+        collapses[collapse_count++] = {
+          b, a, QuadricEvaluate(&merged, positions[a]) / weight
+        };
+      }
+    }
+  }
+  Collapse *sorted = PushArrayNoZero<Collapse>(scratch, collapse_count);
+  SortCollapses(collapses, sorted, collapse_count);
+  collapses = sorted;
+
+  // a collapse owns the one ring of the vertex it moves, so the flip checks
+  // of collapses taken in the same pass never see each other's changes
+  u8 *claimed = PushArray<u8>(scratch, vertex_count);
+  u32 *remap = PushArrayNoZero<u32>(scratch, vertex_count);
+  for (u32 v = 0; v < vertex_count; v++)
+  {
+    remap[v] = v;
+  }
+  // each collapse removes about two triangles
+  u32 collapse_budget = (index_count - target_index_count) / 6 + 1;
+  u32 applied = 0;
+  for (u32 i = 0; i < collapse_count && applied < collapse_budget; i++)
+  {
+    Collapse collapse = collapses[i];
+    if (collapse.cost > max_cost)
+    {
+      break;
+    }
+    if (claimed[collapse.from] || claimed[collapse.to])
+    {
+      continue;
+    }
+
+    bool flips = false;
+    for (u32 a = adjacency_offsets[collapse.from];
+         a < adjacency_offsets[collapse.from + 1] && !flips;
+         a++)
+    {
+      const u32 *triangle = &indices[adjacency[a] * 3];
+      if (triangle[0] != collapse.to && triangle[1] != collapse.to &&
+          triangle[2] != collapse.to)
+      {
+        flips = FlipsTriangle(positions, triangle, collapse.from, collapse.to);
+      }
+    }
+    if (flips)
+    {
+      continue;
+    }
+
+    for (u32 a = adjacency_offsets[collapse.from];
+         a < adjacency_offsets[collapse.from + 1];
+         a++)
+    {
+      const u32 *triangle = &indices[adjacency[a] * 3];
+      claimed[triangle[0]] = 1;
+      claimed[triangle[1]] = 1;
+      claimed[triangle[2]] = 1;
+    }
+    remap[collapse.from] = collapse.to;
+    QuadricAdd(&quadrics[collapse.to], &quadrics[collapse.from]);
+    *error = fmaxf(*error, collapse.cost);
+    applied++;
+  }
+
+  // rewrite in place, triangles that lost a corner drop out
+  u32 write = 0;
+  if (applied > 0)
+  {
+    for (u32 t = 0; t < triangle_count; t++)
+    {
+      u32 a = remap[indices[t * 3 + 0]];
+      u32 b = remap[indices[t * 3 + 1]];
+      u32 c = remap[indices[t * 3 + 2]];
+      if (a != b && b != c && a != c)
+      {
+        indices[write++] = a;
+        indices[write++] = b;
+        indices[write++] = c;
+      }
+    }
+  }
+  else
+  {
+    write = index_count;
+  }
+
+  ArenaTempEnd(temp);
+  return write;
+}
+
+// appends coarser lods to mesh->indices. each level aims for ratio times the
+// previous triangle count and stops once a collapse would move the surface
+// more than max_error, relative to the mesh extent. the new index array comes
+// from arena
+void GenerateLods(RawMesh *mesh, Arena *arena, float ratio, float max_error)
+{
+  u32 base_count = mesh->lods[0].index_count;
+  if (mesh->lod_count != 1 || base_count < 3 || mesh->vertex_count == 0)
+  {
+    return;
+  }
+  ArenaTemp temp = GetScratch(&arena, 1);
+  Arena *scratch = temp.arena;
+
+  // simplify in a unit box so costs are relative to the mesh extent
+  HMM_Vec3 min = HMM_V3(INFINITY, INFINITY, INFINITY);
+  HMM_Vec3 max = HMM_V3(-INFINITY, -INFINITY, -INFINITY);
+  ComputePositionBounds(mesh, &min, &max);
+  HMM_Vec3 size = HMM_SubV3(max, min);
+  float extent = fmaxf(size.X, fmaxf(size.Y, size.Z));
+  float inverse_extent = extent > 0.0f ? 1.0f / extent : 0.0f;
+  HMM_Vec3 *positions = PushArrayNoZero<HMM_Vec3>(scratch, mesh->vertex_count);
+  for (u32 v = 0; v < mesh->vertex_count; v++)
+  {
+    Vertex *vertex = &mesh->vertices[v];
+    positions[v] = HMM_MulV3F(
+      HMM_SubV3(HMM_V3(vertex->x, vertex->y, vertex->z), min), inverse_extent);
+  }
+
+  u32 *indices = PushArrayNoZero<u32>(scratch, base_count);
+  memcpy(indices, mesh->indices, sizeof(u32) * base_count);
+  u32 index_count = base_count - base_count % 3;
+
+  Quadric *quadrics = PushArray<Quadric>(scratch, mesh->vertex_count);
+  for (u32 i = 0; i < index_count; i += 3)
+  {
+    Quadric q = {};
+    QuadricAddTriangle(&q,
+                       positions[indices[i + 0]],
+                       positions[indices[i + 1]],
+                       positions[indices[i + 2]]);
+    for (u32 k = 0; k < 3; k++)
+    {
+      QuadricAdd(&quadrics[indices[i + k]], &q);
+    }
+  }
+
+  // edges used by anything but exactly two triangles are borders, seams or
+  // non manifold, their vertices stay put
+  u8 *locked = PushArray<u8>(scratch, mesh->vertex_count);
+  HashMap<u64, u32> edges = HashMapInit<u64, u32>(scratch, index_count * 2);
+  for (u32 i = 0; i < index_count; i++)
+  {
+    u32 a = indices[i];
+    u32 b = indices[i - i % 3 + (i + 1) % 3];
+    u64 key = a < b ? ((u64)a << 32) | b : ((u64)b << 32) | a;
+    bool inserted;
+    u32 *uses = HashMapGetOrPut(&edges, key, 0u, &inserted);
+    (*uses)++;
+  }
+  for (u32 i = 0; i < index_count; i++)
+  {
+    u32 a = indices[i];
+    u32 b = indices[i - i % 3 + (i + 1) % 3];
+    u64 key = a < b ? ((u64)a << 32) | b : ((u64)b << 32) | a;
+    if (*HashMapGet(&edges, key) != 2)
+    {
+      locked[a] = 1;
+      locked[b] = 1;
+    }
+  }
+
+  // snapshots of each level, all back to back after lod 0
+  u32 *lod_indices = PushArrayNoZero<u32>(scratch, base_count * MESH_MAX_LODS);
+  u32 lod_index_total = 0;
+  float max_cost = max_error * max_error;
+  float error = 0.0f;
+  u32 previous_count = index_count;
+  for (u32 level = 1; level < MESH_MAX_LODS; level++)
+  {
+    u32 target = (u32)((float)previous_count * ratio);
+    target -= target % 3;
+    while (index_count > target)
+    {
+      u32 next = CollapsePass(scratch,
+                              positions,
+                              quadrics,
+                              locked,
+                              mesh->vertex_count,
+                              indices,
+                              index_count,
+                              target,
+                              max_cost,
+                              &error);
+      if (next == index_count)
+      {
+        break;
+      }
+      index_count = next;
+    }
+    // stuck against the error bound or the locked vertices, a level that
+    // barely shrinks isn't worth the memory
+    if (index_count == 0 || index_count > previous_count - previous_count / 8)
+    {
+      break;
+    }
+
+    MeshLod *lod = &mesh->lods[mesh->lod_count++];
+    lod->index_offset = base_count + lod_index_total;
+    lod->index_count = index_count;
+    lod->error = sqrtf(error) * extent;
+    memcpy(lod_indices + lod_index_total, indices, sizeof(u32) * index_count);
+    lod_index_total += index_count;
+    previous_count = index_count;
+  }
+
+  if (mesh->lod_count > 1)
+  {
+    u32 *all = PushArrayNoZero<u32>(arena, base_count + lod_index_total);
+    memcpy(all, mesh->indices, sizeof(u32) * base_count);
+    memcpy(all + base_count, lod_indices, sizeof(u32) * lod_index_total);
+    mesh->indices = all;
+    mesh->index_count = base_count + lod_index_total;
+  }
+
+  debug("generated %u lods, %u triangles down to %u, error %.4f",
+        mesh->lod_count,
+        base_count / 3,
+        mesh->lods[mesh->lod_count - 1].index_count / 3,
+        mesh->lods[mesh->lod_count - 1].error);
+  ReleaseScratch(temp);
+}
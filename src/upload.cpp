@@ -0,0 +1,353 @@
+#include "headers.h"
+
+// uploads
+//     staging to device local copies recorded on the transfer queue. callers
+//     reserve space in a persistently mapped staging ring and write into it,
+//     UploadFlush submits everything reserved since the last flush as one
+//     batch that signals the next value of a timeline semaphore. that value
+//     is the batch's ticket. the frame loop polls the semaphore, acquires
+//     finished ranges on the graphics queue and waits on the timeline in its
+//     own submit, so neither side ever idles the other
+//
+
+void CreateUploader(State *state)
+{
+  Uploader *uploader = &state->uploader;
+  VkCommandPoolCreateInfo pool_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+    .queueFamilyIndex = state->context->transfer_queue_index,
+  };
+  validate(vkCreateCommandPool(
+             state->context->device, &pool_info, NULL, &uploader->command_pool),
+           "could not create upload command pool");
+
+  VkSemaphoreTypeCreateInfo type_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+    .initialValue = 0,
+  };
+  VkSemaphoreCreateInfo semaphore_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    .pNext = &type_info,
+  };
+  validate(vkCreateSemaphore(state->context->device,
+                             &semaphore_info,
+                             NULL,
+                             &uploader->timeline),
+           "could not create upload timeline semaphore");
+
+  VkBufferCreateInfo ring_info = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .size = UPLOAD_RING_SIZE,
+    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+  };
+  VmaAllocationCreateInfo ring_alloc_info = {
+    .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .usage = VMA_MEMORY_USAGE_CPU_ONLY,
+  };
+  VmaAllocationInfo ring_result = {};
+  validate(vmaCreateBuffer(state->context->allocator,
+                           &ring_info,
+                           &ring_alloc_info,
+                           &uploader->ring_buffer,
+                           &uploader->ring_allocation,
+                           &ring_result),
+           "could not allocate staging ring");
+  uploader->ring = (u8 *)ring_result.pMappedData;
+  uploader->ring_head = 0;
+  uploader->ring_tail = 0;
+
+  uploader->next_ticket = 1;
+  uploader->acquired_ticket = 0;
+  uploader->arena = ArenaReserve(megabytes(64), ARENA_FLAG_VIRTUAL);
+  ArenaSetName(&uploader->arena, "upload");
+  uploader->open_copies = ArrayInit<UploadCopy>(&uploader->arena, 64);
+  uploader->batches = ArrayInit<UploadBatch>(&state->permanent_arena, 16);
+  debug("created uploader with a %.1f MB staging ring",
+        UPLOAD_RING_SIZE / (1024.0 * 1024.0));
+}
+
+static bool UploadNeedsOwnershipTransfer(State *state)
+{
+  return state->context->transfer_queue_index != state->context->queue_index;
+}
+
+// moves the ring tail past every batch the transfer queue has finished
+static void UploadRetireRing(Uploader *uploader, u64 completed)
+{
+  for (u32 i = 0; i < uploader->batches.count; i++)
+  {
+    if (uploader->batches[i].ticket > completed)
+    {
+      break;
+    }
+    uploader->ring_tail = uploader->batches[i].ring_end;
+  }
+}
+
+// submits every copy reserved since the last flush on the transfer queue,
+// one vkCmdCopyBuffer per destination. returns the batch's ticket, 0 when
+// nothing was reserved
+u64 UploadFlush(State *state)
+{
+  Uploader *uploader = &state->uploader;
+  if (uploader->open_copies.count == 0)
+  {
+    return 0;
+  }
+
+  UploadBatch *batch = ArrayPush(&uploader->batches);
+  batch->ticket = uploader->next_ticket++;
+  batch->copies = uploader->open_copies.data;
+  batch->copy_count = uploader->open_copies.count;
+  batch->ring_end = uploader->ring_head;
+  uploader->open_copies = ArrayInit<UploadCopy>(&uploader->arena, 64);
+
+  VkCommandBufferAllocateInfo command_buffer_alloc_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+    .commandPool = uploader->command_pool,
+    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+    .commandBufferCount = 1,
+  };
+  validate(vkAllocateCommandBuffers(state->context->device,
+                                    &command_buffer_alloc_info,
+                                    &batch->command_buffer),
+           "could not allocate upload command buffer");
+
+  VkCommandBufferBeginInfo begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  vkBeginCommandBuffer(batch->command_buffer, &begin_info);
+
+  // group the regions by destination, there's rarely more than one
+  ArenaTemp temp = GetScratch(NULL, 0);
+  VkBufferCopy *regions =
+    PushArrayNoZero<VkBufferCopy>(temp.arena, batch->copy_count);
+  bool *recorded = PushArray<bool>(temp.arena, batch->copy_count);
+  u32 command_count = 0;
+  for (u32 i = 0; i < batch->copy_count; i++)
+  {
+    if (recorded[i])
+    {
+      continue;
+    }
+    VkBuffer buffer = batch->copies[i].buffer;
+    u32 region_count = 0;
+    for (u32 k = i; k < batch->copy_count; k++)
+    {
+      if (!recorded[k] && batch->copies[k].buffer == buffer)
+      {
+        regions[region_count++] = batch->copies[k].region;
+        recorded[k] = true;
+      }
+    }
+    vkCmdCopyBuffer(batch->command_buffer,
+                    uploader->ring_buffer,
+                    buffer,
+                    region_count,
+                    regions);
+    command_count++;
+  }
+
+  // release the written ranges to the graphics family, UploadAcquire records
+  // the matching acquire
+  if (UploadNeedsOwnershipTransfer(state))
+  {
+    VkBufferMemoryBarrier2 *barriers =
+      PushArray<VkBufferMemoryBarrier2>(temp.arena, batch->copy_count);
+    for (u32 i = 0; i < batch->copy_count; i++)
+    {
+      barriers[i] = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+        .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .srcQueueFamilyIndex = state->context->transfer_queue_index,
+        .dstQueueFamilyIndex = state->context->queue_index,
+        .buffer = batch->copies[i].buffer,
+        .offset = batch->copies[i].region.dstOffset,
+        .size = batch->copies[i].region.size,
+      };
+    }
+    VkDependencyInfo release_info = {
+      .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+      .bufferMemoryBarrierCount = batch->copy_count,
+      .pBufferMemoryBarriers = barriers,
+    };
+    vkCmdPipelineBarrier2(batch->command_buffer, &release_info);
+  }
+  ReleaseScratch(temp);
+  vkEndCommandBuffer(batch->command_buffer);
+
+  VkCommandBufferSubmitInfo command_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+    .commandBuffer = batch->command_buffer,
+  };
+  VkSemaphoreSubmitInfo signal_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+    .semaphore = uploader->timeline,
+    .value = batch->ticket,
+    .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+  };
+  VkSubmitInfo2 submit_info = {
+    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+    .commandBufferInfoCount = 1,
+    .pCommandBufferInfos = &command_info,
+    .signalSemaphoreInfoCount = 1,
+    .pSignalSemaphoreInfos = &signal_info,
+  };
+  validate(vkQueueSubmit2(
+             state->context->transfer_queue, 1, &submit_info, VK_NULL_HANDLE),
+           "could not submit upload");
+  debug("upload ticket %llu: %u regions in %u copy commands",
+        (unsigned long long)batch->ticket,
+        batch->copy_count,
+        command_count);
+  return batch->ticket;
+}
+
+// reserves size bytes of the staging ring for a copy into buffer at offset and
+// returns where to write them. the data has to be in place before the next
+// UploadFlush. ticket is set to the batch the copy lands in. when the ring is
+// full this flushes and waits for the oldest batches, which only happens when
+// uploads outrun the copy engine
+void *UploadReserve(State *state,
+                    VkBuffer buffer,
+                    u64 offset,
+                    u64 size,
+                    u64 *ticket)
+{
+  Uploader *uploader = &state->uploader;
+  assert(size > 0 && size <= UPLOAD_MAX_RESERVE);
+  // 16 byte alignment keeps the simd writers on aligned rows
+  u64 head = ForwardAlign(uploader->ring_head, 16);
+  u64 ring_offset = head % UPLOAD_RING_SIZE;
+  if (ring_offset + size > UPLOAD_RING_SIZE)
+  {
+    // doesn't fit before the end, skip to the start of the next lap
+    head += UPLOAD_RING_SIZE - ring_offset;
+    ring_offset = 0;
+  }
+
+  if (head + size - uploader->ring_tail > UPLOAD_RING_SIZE)
+  {
+    UploadFlush(state);
+    for (u32 i = 0; i < uploader->batches.count &&
+                    head + size - uploader->ring_tail > UPLOAD_RING_SIZE;
+         i++)
+    {
+      VkSemaphoreWaitInfo wait_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &uploader->timeline,
+        .pValues = &uploader->batches[i].ticket,
+      };
+      validate(vkWaitSemaphores(state->context->device, &wait_info, UINT64_MAX),
+               "could not wait for staging ring space");
+      UploadRetireRing(uploader, uploader->batches[i].ticket);
+    }
+  }
+  uploader->ring_head = head + size;
+
+  // back to back writes into one destination merge into a single region
+  UploadCopy *last =
+    uploader->open_copies.count
+      ? &uploader->open_copies[uploader->open_copies.count - 1]
+      : NULL;
+  if (last && last->buffer == buffer &&
+      last->region.srcOffset + last->region.size == ring_offset &&
+      last->region.dstOffset + last->region.size == offset)
+  {
+    last->region.size += size;
+  }
+  else
+  {
+    UploadCopy copy = {
+      .buffer = buffer,
+      .region = { ring_offset, offset, size },
+    };
+    ArrayPush(&uploader->open_copies, copy);
+  }
+  *ticket = uploader->next_ticket;
+  return uploader->ring + ring_offset;
+}
+
+// records acquire barriers for every finished copy into the frame's command
+// buffer and retires batches the transfer queue is done with. returns the
+// timeline value the frame's submit has to wait on, 0 when there is none
+u64 UploadAcquire(State *state, VkCommandBuffer buffer)
+{
+  Uploader *uploader = &state->uploader;
+  if (uploader->batches.count == 0)
+  {
+    return 0;
+  }
+  u64 completed = 0;
+  validate(vkGetSemaphoreCounterValue(
+             state->context->device, uploader->timeline, &completed),
+           "could not read upload timeline");
+  UploadRetireRing(uploader, completed);
+
+  ArenaTemp temp = GetScratch(NULL, 0);
+  Array<VkBufferMemoryBarrier2> barriers =
+    ArrayInit<VkBufferMemoryBarrier2>(temp.arena, 16);
+  u64 wait_value = 0;
+  u32 kept = 0;
+  for (u32 i = 0; i < uploader->batches.count; i++)
+  {
+    UploadBatch batch = uploader->batches[i];
+    if (batch.ticket > completed)
+    {
+      uploader->batches[kept++] = batch;
+      continue;
+    }
+    if (UploadNeedsOwnershipTransfer(state))
+    {
+      for (u32 k = 0; k < batch.copy_count; k++)
+      {
+        VkBufferMemoryBarrier2 barrier = {
+          .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+          .dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT |
+                          VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT,
+          .dstAccessMask = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT |
+                           VK_ACCESS_2_INDEX_READ_BIT,
+          .srcQueueFamilyIndex = state->context->transfer_queue_index,
+          .dstQueueFamilyIndex = state->context->queue_index,
+          .buffer = batch.copies[k].buffer,
+          .offset = batch.copies[k].region.dstOffset,
+          .size = batch.copies[k].region.size,
+        };
+        ArrayPush(&barriers, barrier);
+      }
+    }
+    vkFreeCommandBuffers(state->context->device,
+                         uploader->command_pool,
+                         1,
+                         &batch.command_buffer);
+    wait_value = batch.ticket > wait_value ? batch.ticket : wait_value;
+  }
+  uploader->batches.count = kept;
+  if (kept == 0 && uploader->open_copies.count == 0)
+  {
+    ArenaReset(&uploader->arena);
+    uploader->open_copies = ArrayInit<UploadCopy>(&uploader->arena, 64);
+  }
+
+  if (barriers.count > 0)
+  {
+    VkDependencyInfo acquire_info = {
+      .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+      .bufferMemoryBarrierCount = barriers.count,
+      .pBufferMemoryBarriers = barriers.data,
+    };
+    vkCmdPipelineBarrier2(buffer, &acquire_info);
+  }
+  ReleaseScratch(temp);
+
+  if (wait_value > uploader->acquired_ticket)
+  {
+    uploader->acquired_ticket = wait_value;
+  }
+  return wait_value;
+}
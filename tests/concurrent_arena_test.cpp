@@ -0,0 +1,198 @@
+#include "../src/arena.cpp"
+#include "../src/concurrent_arena.cpp"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// concurrent arena stress test, exits non zero on the first failure
+//     concurrent_arena_test [thread_count] [pushes_per_thread]
+//
+#define check(cond, ...)                                                       \
+  do                                                                           \
+  {                                                                            \
+    if (!(cond))                                                               \
+    {                                                                          \
+      fprintf(stderr, "[FAIL] %s:%d: ", __FILE__, __LINE__);                   \
+      fprintf(stderr, __VA_ARGS__);                                            \
+      fprintf(stderr, "\n");                                                   \
+      exit(1);                                                                 \
+    }                                                                          \
+  } while (0)
+
+struct Claim
+{
+  u8 *start;
+  u64 size;
+};
+
+struct ProducerResult
+{
+  std::vector<Claim> claims;
+  u64 misaligned;
+};
+
+static u64 NextRandom(u64 *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static u8 FillByte(u32 thread, u32 push)
+{
+  return (u8)(thread * 131 + push * 7 + 1);
+}
+
+// mostly chunk sized pushes with the odd one big enough to bypass the chunk
+static void Produce(ConcurrentArena *arena,
+                    u32 thread,
+                    u32 push_count,
+                    ProducerResult *result)
+{
+  u64 rng = 0x9e3779b97f4a7c15ull * (thread + 1);
+  result->claims.reserve(push_count);
+  for (u32 i = 0; i < push_count; i++)
+  {
+    u64 roll = NextRandom(&rng);
+    u64 size = (roll % 64 == 0) ? 1 + roll % (64 * 1024) : 1 + roll % 512;
+    u64 alignment = (u64)1 << (NextRandom(&rng) % 8);
+
+    u8 *ptr = (u8 *)ConcurrentArenaPushAlignNoZero(arena, size, alignment);
+    if ((u64)ptr & (alignment - 1))
+    {
+      result->misaligned++;
+    }
+    memset(ptr, FillByte(thread, i), size);
+    result->claims.push_back({ptr, size});
+  }
+}
+
+// hammers one arena from every thread at once, then checks every claim is in
+// range, aligned, disjoint from every other claim and still holds its fill
+static void TestProducers(u32 thread_count, u32 push_count, u32 rounds)
+{
+  ConcurrentArena arena = {};
+  ConcurrentArenaInit(&arena, (u64)4 * 1024 * 1024 * 1024);
+
+  for (u32 round = 0; round < rounds; round++)
+  {
+    std::vector<ProducerResult> results(thread_count);
+    std::vector<std::thread> threads;
+    for (u32 t = 0; t < thread_count; t++)
+    {
+      threads.emplace_back(Produce, &arena, t, push_count, &results[t]);
+    }
+    for (std::thread &thread : threads)
+    {
+      thread.join();
+    }
+
+    std::vector<Claim> claims;
+    for (u32 t = 0; t < thread_count; t++)
+    {
+      check(results[t].misaligned == 0,
+            "round %u thread %u: %llu misaligned pushes",
+            round,
+            t,
+            (unsigned long long)results[t].misaligned);
+      for (u32 i = 0; i < push_count; i++)
+      {
+        Claim claim = results[t].claims[i];
+        check(claim.start >= arena.memory &&
+                claim.start + claim.size <= arena.memory + arena.size,
+              "round %u thread %u push %u outside the reservation",
+              round,
+              t,
+              i);
+        for (u64 b = 0; b < claim.size; b++)
+        {
+          check(claim.start[b] == FillByte(t, i),
+                "round %u thread %u push %u overwritten at byte %llu",
+                round,
+                t,
+                i,
+                (unsigned long long)b);
+        }
+        claims.push_back(claim);
+      }
+    }
+
+    std::sort(claims.begin(),
+              claims.end(),
+              [](const Claim &a, const Claim &b) { return a.start < b.start; });
+    for (u64 i = 1; i < claims.size(); i++)
+    {
+      check(claims[i - 1].start + claims[i - 1].size <= claims[i].start,
+            "round %u: claims at %p and %p overlap",
+            round,
+            (void *)claims[i - 1].start,
+            (void *)claims[i].start);
+    }
+
+    printf("round %u: %u threads, %zu pushes, %.1f MiB claimed\n",
+           round,
+           thread_count,
+           claims.size(),
+           arena.offset.load() / (1024.0 * 1024.0));
+    ConcurrentArenaReset(&arena);
+  }
+
+  ConcurrentArenaRelease(&arena);
+}
+
+// a reset must make this thread drop its cached chunk and start over
+static void TestReset()
+{
+  ConcurrentArena arena = {};
+  ConcurrentArenaInit(&arena, (u64)64 * 1024 * 1024);
+
+  u8 *first = (u8 *)ConcurrentArenaPush(&arena, 64);
+  u8 *second = (u8 *)ConcurrentArenaPush(&arena, 64);
+  check(second > first && second < first + CONCURRENT_ARENA_CHUNK_SIZE,
+        "second push did not come from the cached chunk");
+
+  ConcurrentArenaReset(&arena);
+  u8 *after = (u8 *)ConcurrentArenaPush(&arena, 64);
+  check(after == arena.memory, "push after reset did not restart the arena");
+  check(arena.offset.load() == CONCURRENT_ARENA_CHUNK_SIZE,
+        "push after reset did not claim a fresh chunk");
+
+  ConcurrentArenaRelease(&arena);
+}
+
+// release then init on the same struct, the chunk this thread cached before
+// the release points at unmapped memory and must not be handed out again
+static void TestReleaseReinit()
+{
+  ConcurrentArena arena = {};
+  for (u32 cycle = 0; cycle < 8; cycle++)
+  {
+    ConcurrentArenaInit(&arena, (u64)64 * 1024 * 1024);
+
+    u8 *ptr = (u8 *)ConcurrentArenaPush(&arena, 64);
+    check(arena.offset.load() == CONCURRENT_ARENA_CHUNK_SIZE,
+          "cycle %u: first push reused a chunk from before the release",
+          cycle);
+    check(ptr >= arena.memory &&
+            ptr + 64 <= arena.memory + CONCURRENT_ARENA_CHUNK_SIZE,
+          "cycle %u: first push is outside the new reservation",
+          cycle);
+    memset(ptr, 0xab, 64);
+
+    ConcurrentArenaRelease(&arena);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  u32 thread_count = argc > 1 ? (u32)atoi(argv[1]) : 16;
+  u32 push_count = argc > 2 ? (u32)atoi(argv[2]) : 20000;
+
+  TestReset();
+  TestReleaseReinit();
+  TestProducers(thread_count, push_count, 3);
+
+  printf("concurrent arena: ok\n");
+  return 0;
+}
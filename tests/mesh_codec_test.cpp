@@ -0,0 +1,501 @@
+#include "../src/headers.h"
+
+#include "../src/mesh_codec.cpp"
+#include <vector>
+
+int g_debug_enabled = 0;
+
+// mesh codec round trips on random and adversarial streams, exits non zero
+// on the first failure. built a second time without sse2 to cover the scalar
+// decoder as well
+//     mesh_codec_test
+//
+#define check(cond, ...)                                                       \
+  do                                                                           \
+  {                                                                            \
+    if (!(cond))                                                               \
+    {                                                                          \
+      fprintf(stderr, "[FAIL] %s:%d: ", __FILE__, __LINE__);                   \
+      fprintf(stderr, __VA_ARGS__);                                            \
+      fprintf(stderr, "\n");                                                   \
+      exit(1);                                                                 \
+    }                                                                          \
+  } while (0)
+
+static u64 NextRandom(u64 *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+// counts around groups, blocks and the decode chunk
+static const u32 stream_counts[] = {
+  0,   1,   2,   15,  16,   17,   31,   255,
+  256, 257, 511, 512, 1000, 4096, 4099, 4096 + 256 + 7,
+};
+
+// every group mode on its own, against the bit layout EncodePlane writes
+static void TestDecodeGroup()
+{
+  u64 rng = 0x9e3779b97f4a7c15ull;
+  u8 largest[4] = { 0, 3, 15, 255 };
+  for (u32 mode = 0; mode < 4; mode++)
+  {
+    for (u32 round = 0; round < 1000; round++)
+    {
+      u8 expected[MESH_CODEC_GROUP];
+      for (u32 i = 0; i < MESH_CODEC_GROUP; i++)
+      {
+        u64 roll = NextRandom(&rng);
+        // the top of the range matters most, hit it often
+        expected[i] = roll % 4 == 0 ? largest[mode]
+                                    : (u8)(roll >> 8) % (largest[mode] + 1);
+      }
+      u8 in[MESH_CODEC_GROUP] = {};
+      for (u32 i = 0; mode == 1 && i < MESH_CODEC_GROUP; i++)
+      {
+        in[i / 4] |= (u8)(expected[i] << ((i % 4) * 2));
+      }
+      for (u32 i = 0; mode == 2 && i < MESH_CODEC_GROUP; i++)
+      {
+        in[i / 2] |= (u8)(expected[i] << ((i % 2) * 4));
+      }
+      if (mode == 3)
+      {
+        memcpy(in, expected, sizeof(in));
+      }
+
+      u8 out[MESH_CODEC_GROUP];
+      memset(out, 0xcd, sizeof(out));
+      DecodeGroup(out, in, mode);
+      check(memcmp(out, expected, sizeof(out)) == 0,
+            "mode %u group decoded wrong in round %u",
+            mode,
+            round);
+    }
+  }
+}
+
+static void TestUndoByteDeltas()
+{
+  u64 rng = 0x2545f4914f6cdd1dull;
+  for (u32 n = 0; n <= MESH_CODEC_BLOCK; n++)
+  {
+    u8 plane[MESH_CODEC_BLOCK];
+    u8 expected[MESH_CODEC_BLOCK];
+    u8 start = (u8)NextRandom(&rng);
+    u8 previous = start;
+    for (u32 i = 0; i < n; i++)
+    {
+      u64 roll = NextRandom(&rng);
+      // plain random bytes, and the extremes that wrap
+      plane[i] = n % 3 == 0 ? (u8)roll : (roll & 1) ? 0xff : 0xfe;
+      u8 zigzag = plane[i];
+      previous = (u8)(previous + ((zigzag >> 1) ^ (u8)-(zigzag & 1)));
+      expected[i] = previous;
+    }
+    u8 carry = start;
+    UndoByteDeltas(plane, n, &carry);
+    check(memcmp(plane, expected, n) == 0, "byte deltas of %u bytes", n);
+    check(carry == previous,
+          "carry %u after %u bytes, expected %u",
+          carry,
+          n,
+          previous);
+  }
+}
+
+// the planes to words transpose, which only exists in the sse2 decoder
+static void TestGatherWords()
+{
+#if defined(__SSE2__) || defined(_M_X64)
+  u64 rng = 0xd1b54a32d192ed03ull;
+  alignas(16) u8 planes[MESH_CODEC_INDEX_PLANES][MESH_CODEC_BLOCK];
+  for (u32 k = 0; k < MESH_CODEC_INDEX_PLANES; k++)
+  {
+    for (u32 i = 0; i < MESH_CODEC_BLOCK; i++)
+    {
+      planes[k][i] = (u8)NextRandom(&rng);
+    }
+  }
+  for (u32 i = 0; i < MESH_CODEC_BLOCK; i += MESH_CODEC_GROUP)
+  {
+    __m128i words[4];
+    GatherWords(words, planes, i);
+    u32 gathered[MESH_CODEC_GROUP];
+    memcpy(gathered, words, sizeof(gathered));
+    for (u32 j = 0; j < MESH_CODEC_GROUP; j++)
+    {
+      u32 expected = (u32)planes[0][i + j] | (u32)planes[1][i + j] << 8 |
+                     (u32)planes[2][i + j] << 16 | (u32)planes[3][i + j] << 24;
+      check(gathered[j] == expected,
+            "word %u gathered as %08x, expected %08x",
+            i + j,
+            gathered[j],
+            expected);
+    }
+  }
+#endif
+}
+
+// 0 random bytes, every group raw. 1 all zero, every group empty. 2 every
+// byte flipping between the extremes, the largest zigzag steps. 3 a smooth
+// mesh like stream with odd floats mixed in, mostly 2 and 4 bit groups
+static std::vector<Vertex> VertexPattern(u32 pattern, u32 count, u64 *rng)
+{
+  std::vector<Vertex> vertices(count);
+  u8 *bytes = (u8 *)vertices.data();
+  u64 size = (u64)count * sizeof(Vertex);
+  for (u64 i = 0; i < size; i++)
+  {
+    u64 roll = NextRandom(rng);
+    if (pattern == 0)
+    {
+      bytes[i] = (u8)roll;
+    }
+    else if (pattern == 2)
+    {
+      bytes[i] = (i / sizeof(Vertex)) % 2 ? 0xff : 0x00;
+    }
+    else
+    {
+      bytes[i] = 0;
+    }
+  }
+  float specials[] = { NAN, INFINITY, -INFINITY, -0.0f, 1e-45f, 3.4e38f };
+  for (u32 i = 0; pattern == 3 && i < count; i++)
+  {
+    float t = (float)i * 0.01f;
+    vertices[i].x = sinf(t);
+    vertices[i].y = cosf(t);
+    vertices[i].z = t;
+    vertices[i].ny = 1.0f;
+    vertices[i].u = i % 97 == 0 ? specials[(i / 97) % 6] : t * 0.5f;
+    vertices[i].v = (float)(NextRandom(rng) % 3);
+  }
+  return vertices;
+}
+
+// 0 random values. 1 a triangle list over a strip, small deltas both ways.
+// 2 the largest deltas there are. 3 random values up to 5000
+static std::vector<u32> IndexPattern(u32 pattern, u32 count, u64 *rng)
+{
+  std::vector<u32> indices(count);
+  for (u32 i = 0; i < count; i++)
+  {
+    u64 roll = NextRandom(rng);
+    if (pattern == 0)
+    {
+      indices[i] = (u32)roll;
+    }
+    else if (pattern == 1)
+    {
+      indices[i] = i / 3 + i % 3;
+    }
+    else if (pattern == 2)
+    {
+      indices[i] = i % 2 ? UINT32_MAX : 0;
+    }
+    else
+    {
+      indices[i] = (u32)(roll % 5000);
+    }
+  }
+  return indices;
+}
+
+// a split of count into calls of whole blocks, the last call takes the rest
+static std::vector<u32> Splits(u32 count, u32 kind, u64 *rng)
+{
+  std::vector<u32> splits;
+  u32 left = count;
+  while (left > 0)
+  {
+    u32 blocks = kind == 0   ? UINT32_MAX / MESH_CODEC_BLOCK
+                 : kind == 1 ? 1
+                             : 1 + (u32)(NextRandom(rng) % 5);
+    u32 n = (u64)blocks * MESH_CODEC_BLOCK < left ? blocks * MESH_CODEC_BLOCK
+                                                  : left;
+    splits.push_back(n);
+    left -= n;
+  }
+  return splits;
+}
+
+static void TestVertexRoundTrip()
+{
+  u64 rng = 0x853c49e6748fea9bull;
+  for (u32 pattern = 0; pattern < 4; pattern++)
+  {
+    for (u32 count : stream_counts)
+    {
+      std::vector<Vertex> vertices = VertexPattern(pattern, count, &rng);
+      std::vector<u8> packed(MeshCodecBound(count, sizeof(Vertex)));
+      u64 size = EncodeVertexStream(packed.data(), vertices.data(), count);
+      check(size <= packed.size(),
+            "vertex stream of %u overran its bound",
+            count);
+      check(MeshCodecStreamValid(count, sizeof(Vertex), packed.data(), size),
+            "pattern %u vertex stream of %u is not valid",
+            pattern,
+            count);
+
+      for (u32 kind = 0; kind < 3; kind++)
+      {
+        std::vector<Vertex> decoded(count + 1);
+        memset((void *)decoded.data(), 0xcd, sizeof(Vertex) * (count + 1));
+        MeshCodecReader reader;
+        MeshCodecReaderInit(&reader, packed.data(), size);
+        u32 first = 0;
+        for (u32 n : Splits(count, kind, &rng))
+        {
+          check(DecodeVertexBlocks(&reader, decoded.data() + first, n),
+                "pattern %u vertex stream of %u failed at %u",
+                pattern,
+                count,
+                first);
+          first += n;
+        }
+        check(count == 0 || memcmp(decoded.data(),
+                                   vertices.data(),
+                                   sizeof(Vertex) * count) == 0,
+              "pattern %u vertex stream of %u split %u decoded wrong",
+              pattern,
+              count,
+              kind);
+        check(((u8 *)&decoded[count])[0] == 0xcd,
+              "vertex decode of %u wrote past the end",
+              count);
+        check(reader.in == packed.data() + size,
+              "vertex decode of %u stopped %td bytes early",
+              count,
+              packed.data() + size - reader.in);
+      }
+    }
+  }
+}
+
+static void TestIndexRoundTrip()
+{
+  u64 rng = 0xda942042e4dd58b5ull;
+  for (u32 pattern = 0; pattern < 4; pattern++)
+  {
+    for (u32 count : stream_counts)
+    {
+      std::vector<u32> indices = IndexPattern(pattern, count, &rng);
+      std::vector<u8> packed(MeshCodecBound(count, sizeof(u32)));
+      u64 size = EncodeIndexStream(packed.data(), indices.data(), count);
+      check(
+        size <= packed.size(), "index stream of %u overran its bound", count);
+      check(MeshCodecStreamValid(count, sizeof(u32), packed.data(), size),
+            "pattern %u index stream of %u is not valid",
+            pattern,
+            count);
+
+      for (u32 kind = 0; kind < 3; kind++)
+      {
+        std::vector<u32> decoded(count + 1, 0xcdcdcdcd);
+        MeshCodecReader reader;
+        MeshCodecReaderInit(&reader, packed.data(), size);
+        bool clamped = false;
+        u32 first = 0;
+        for (u32 n : Splits(count, kind, &rng))
+        {
+          check(DecodeIndexBlocks(
+                  &reader, decoded.data() + first, n, UINT32_MAX, &clamped),
+                "pattern %u index stream of %u failed at %u",
+                pattern,
+                count,
+                first);
+          first += n;
+        }
+        check(count == 0 || memcmp(decoded.data(),
+                                   indices.data(),
+                                   sizeof(u32) * count) == 0,
+              "pattern %u index stream of %u split %u decoded wrong",
+              pattern,
+              count,
+              kind);
+        check(!clamped, "nothing is past UINT32_MAX but clamped was set");
+        check(decoded[count] == 0xcdcdcdcd,
+              "index decode of %u wrote past the end",
+              count);
+      }
+    }
+  }
+}
+
+// values past max_index come out as max_index and set clamped, the rest is
+// untouched. max_index itself is in range
+static void TestIndexClamp()
+{
+  u64 rng = 0xa0761d6478bd642full;
+  for (u32 count : stream_counts)
+  {
+    u32 max_index = 999;
+    std::vector<u32> indices = IndexPattern(3, count, &rng);
+    bool any_over = false;
+    for (u32 &index : indices)
+    {
+      any_over |= index > max_index;
+    }
+    std::vector<u8> packed(MeshCodecBound(count, sizeof(u32)));
+    u64 size = EncodeIndexStream(packed.data(), indices.data(), count);
+
+    for (u32 kind = 0; kind < 3; kind++)
+    {
+      std::vector<u32> decoded(count);
+      MeshCodecReader reader;
+      MeshCodecReaderInit(&reader, packed.data(), size);
+      bool clamped = false;
+      u32 first = 0;
+      for (u32 n : Splits(count, kind, &rng))
+      {
+        check(DecodeIndexBlocks(
+                &reader, decoded.data() + first, n, max_index, &clamped),
+              "clamped index stream of %u failed at %u",
+              count,
+              first);
+        first += n;
+      }
+      for (u32 i = 0; i < count; i++)
+      {
+        u32 expected = SDL_min(indices[i], max_index);
+        check(decoded[i] == expected,
+              "index %u of %u decoded as %u, expected %u",
+              i,
+              count,
+              decoded[i],
+              expected);
+      }
+      check(clamped == any_over,
+            "clamped is %d for a stream of %u with%s values over",
+            clamped,
+            count,
+            any_over ? "" : " no");
+    }
+  }
+
+  // exactly at the limit and one past it, in the sse2 groups and the tail
+  u32 indices[MESH_CODEC_GROUP + 3];
+  for (u32 past = 0; past < 2; past++)
+  {
+    for (u32 i = 0; i < MESH_CODEC_GROUP + 3; i++)
+    {
+      indices[i] = i % 2 ? 7 + past : 0;
+    }
+    u8 packed[256];
+    u64 size = EncodeIndexStream(packed, indices, MESH_CODEC_GROUP + 3);
+    u32 decoded[MESH_CODEC_GROUP + 3];
+    MeshCodecReader reader;
+    MeshCodecReaderInit(&reader, packed, size);
+    bool clamped = false;
+    check(
+      DecodeIndexBlocks(&reader, decoded, MESH_CODEC_GROUP + 3, 7, &clamped),
+      "limit stream failed");
+    check(clamped == (past == 1), "clamped is %d at limit + %u", clamped, past);
+    for (u32 i = 0; i < MESH_CODEC_GROUP + 3; i++)
+    {
+      check(decoded[i] == (i % 2 ? 7u : 0u),
+            "limit stream index %u is %u",
+            i,
+            decoded[i]);
+    }
+  }
+}
+
+// a stream cut short or with bytes behind it is never valid, and decoding a
+// truncated one fails instead of reading past its end
+static void TestStreamValid()
+{
+  u64 rng = 0x94d049bb133111ebull;
+  for (u32 count : stream_counts)
+  {
+    if (count == 0)
+    {
+      continue;
+    }
+    std::vector<Vertex> vertices = VertexPattern(0, count, &rng);
+    std::vector<u32> indices = IndexPattern(0, count, &rng);
+    std::vector<u8> vertex_packed(MeshCodecBound(count, sizeof(Vertex)) + 1);
+    std::vector<u8> index_packed(MeshCodecBound(count, sizeof(u32)) + 1);
+    u64 vertex_size =
+      EncodeVertexStream(vertex_packed.data(), vertices.data(), count);
+    u64 index_size =
+      EncodeIndexStream(index_packed.data(), indices.data(), count);
+
+    check(!MeshCodecStreamValid(
+            count, sizeof(Vertex), vertex_packed.data(), vertex_size + 1),
+          "overlong vertex stream of %u passed",
+          count);
+    check(!MeshCodecStreamValid(
+            count, sizeof(u32), index_packed.data(), index_size + 1),
+          "overlong index stream of %u passed",
+          count);
+    check(!MeshCodecStreamValid(count + MESH_CODEC_BLOCK,
+                                sizeof(u32),
+                                index_packed.data(),
+                                index_size),
+          "index stream of %u passed for a longer count",
+          count);
+
+    // cut by a byte, two, part of a group, half and everything
+    for (u32 c = 0; c < 5; c++)
+    {
+      u64 cuts[] = { 1, 2, 17, vertex_size / 2, vertex_size };
+      u64 size = vertex_size - SDL_min(cuts[c], vertex_size);
+      check(!MeshCodecStreamValid(
+              count, sizeof(Vertex), vertex_packed.data(), size),
+            "vertex stream of %u cut to %llu bytes passed",
+            count,
+            (unsigned long long)size);
+      // the decoder only sees a copy of exactly the truncated bytes
+      std::vector<u8> truncated(vertex_packed.begin(),
+                                vertex_packed.begin() + size);
+      std::vector<Vertex> decoded(count);
+      MeshCodecReader reader;
+      MeshCodecReaderInit(&reader, truncated.data(), size);
+      check(!DecodeVertexBlocks(&reader, decoded.data(), count),
+            "vertex stream of %u cut to %llu bytes decoded",
+            count,
+            (unsigned long long)size);
+    }
+    for (u32 c = 0; c < 5; c++)
+    {
+      u64 cuts[] = { 1, 2, 17, index_size / 2, index_size };
+      u64 size = index_size - SDL_min(cuts[c], index_size);
+      check(!MeshCodecStreamValid(
+              count, sizeof(u32), index_packed.data(), size),
+            "index stream of %u cut to %llu bytes passed",
+            count,
+            (unsigned long long)size);
+      std::vector<u8> truncated(index_packed.begin(),
+                                index_packed.begin() + size);
+      std::vector<u32> decoded(count);
+      MeshCodecReader reader;
+      MeshCodecReaderInit(&reader, truncated.data(), size);
+      bool clamped = false;
+      check(!DecodeIndexBlocks(
+              &reader, decoded.data(), count, UINT32_MAX, &clamped),
+            "index stream of %u cut to %llu bytes decoded",
+            count,
+            (unsigned long long)size);
+    }
+  }
+}
+
+int main()
+{
+  TestDecodeGroup();
+  TestUndoByteDeltas();
+  TestGatherWords();
+  TestVertexRoundTrip();
+  TestIndexRoundTrip();
+  TestIndexClamp();
+  TestStreamValid();
+
+  printf("mesh codec: ok\n");
+  return 0;
+}
@@ -0,0 +1,420 @@
+#include "../src/headers.h"
+
+#include "../src/arena.cpp"
+#include "../src/meshlet.cpp"
+#include <vector>
+
+int g_debug_enabled = 0;
+
+// meshlet builder checks on generated meshes, exits non zero on the first
+// failure
+//     meshlet_test
+//
+#define check(cond, ...)                                                       \
+  do                                                                           \
+  {                                                                            \
+    if (!(cond))                                                               \
+    {                                                                          \
+      fprintf(stderr, "[FAIL] %s:%d: ", __FILE__, __LINE__);                   \
+      fprintf(stderr, __VA_ARGS__);                                            \
+      fprintf(stderr, "\n");                                                   \
+      exit(1);                                                                 \
+    }                                                                          \
+  } while (0)
+
+struct TestMesh
+{
+  std::vector<Vertex> vertices;
+  std::vector<u32> indices;
+};
+
+struct MeshletOutput
+{
+  Array<Meshlet> meshlets;
+  Array<u32> vertices;
+  Array<u8> triangles;
+};
+
+static u64 NextRandom(u64 *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static float RandomUnit(u64 *state)
+{
+  return (float)(NextRandom(state) >> 40) / (float)(1 << 24);
+}
+
+static RawMesh TestRawMesh(TestMesh *mesh)
+{
+  RawMesh raw = {};
+  raw.vertices = mesh->vertices.data();
+  raw.indices = mesh->indices.data();
+  raw.vertex_count = (u32)mesh->vertices.size();
+  raw.index_count = (u32)mesh->indices.size();
+  return raw;
+}
+
+// a rolling heightfield, bumpy enough that the cones differ per meshlet
+static TestMesh GridMesh(u32 side)
+{
+  TestMesh mesh;
+  for (u32 y = 0; y < side; y++)
+  {
+    for (u32 x = 0; x < side; x++)
+    {
+      Vertex vertex = {};
+      vertex.x = (float)x * 0.25f;
+      vertex.y = (float)y * 0.25f;
+      vertex.z = 0.3f * sinf(vertex.x) * cosf(vertex.y);
+      mesh.vertices.push_back(vertex);
+    }
+  }
+  for (u32 y = 0; y + 1 < side; y++)
+  {
+    for (u32 x = 0; x + 1 < side; x++)
+    {
+      u32 a = y * side + x;
+      u32 b = a + side;
+      u32 quad[6] = { a, a + 1, b + 1, a, b + 1, b };
+      mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+    }
+  }
+  return mesh;
+}
+
+// latitude longitude sphere wound outwards, poles included
+static TestMesh SphereMesh(u32 rings, u32 segments, float radius)
+{
+  TestMesh mesh;
+  for (u32 ring = 0; ring <= rings; ring++)
+  {
+    float theta = HMM_PI32 * (float)ring / (float)rings;
+    for (u32 segment = 0; segment <= segments; segment++)
+    {
+      float phi = 2.0f * HMM_PI32 * (float)segment / (float)segments;
+      Vertex vertex = {};
+      vertex.x = radius * sinf(theta) * cosf(phi);
+      vertex.y = radius * sinf(theta) * sinf(phi);
+      vertex.z = radius * cosf(theta);
+      mesh.vertices.push_back(vertex);
+    }
+  }
+  u32 stride = segments + 1;
+  for (u32 ring = 0; ring < rings; ring++)
+  {
+    for (u32 segment = 0; segment < segments; segment++)
+    {
+      u32 a = ring * stride + segment;
+      u32 b = a + stride;
+      u32 quad[6] = { a, b, b + 1, a, b + 1, a + 1 };
+      mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+    }
+  }
+  return mesh;
+}
+
+static MeshletOutput Build(Arena *arena, TestMesh *mesh)
+{
+  MeshletOutput output = {};
+  output.meshlets = ArrayInit<Meshlet>(arena, 0);
+  output.vertices = ArrayInit<u32>(arena, 0);
+  output.triangles = ArrayInit<u8>(arena, 0);
+  RawMesh raw = TestRawMesh(mesh);
+  u32 count =
+    BuildMeshlets(&raw, &output.meshlets, &output.vertices, &output.triangles);
+  check(count == output.meshlets.count,
+        "returned %u meshlets, pushed %u",
+        count,
+        output.meshlets.count);
+  return output;
+}
+
+static u32 MeshletIndex(const MeshletOutput *output,
+                        const Meshlet *meshlet,
+                        u32 corner)
+{
+  u8 local = output->triangles.data[meshlet->triangle_offset + corner];
+  return output->vertices.data[meshlet->vertex_offset + local];
+}
+
+// the caps hold, the meshlets replay the index list in order, and a meshlet
+// is only closed when the next triangle would have broken a cap
+static void CheckTopology(const char *name,
+                          TestMesh *mesh,
+                          const MeshletOutput *output)
+{
+  u32 index = 0;
+  for (u32 m = 0; m < output->meshlets.count; m++)
+  {
+    const Meshlet *meshlet = &output->meshlets.data[m];
+    check(meshlet->vertex_count > 0 &&
+            meshlet->vertex_count <= MESHLET_MAX_VERTICES,
+          "%s meshlet %u has %u vertices",
+          name,
+          m,
+          meshlet->vertex_count);
+    check(meshlet->triangle_count > 0 &&
+            meshlet->triangle_count <= MESHLET_MAX_TRIANGLES,
+          "%s meshlet %u has %u triangles",
+          name,
+          m,
+          meshlet->triangle_count);
+
+    // local slots are unique within a meshlet
+    for (u32 i = 0; i < meshlet->vertex_count; i++)
+    {
+      for (u32 j = i + 1; j < meshlet->vertex_count; j++)
+      {
+        check(output->vertices.data[meshlet->vertex_offset + i] !=
+                output->vertices.data[meshlet->vertex_offset + j],
+              "%s meshlet %u holds vertex %u twice",
+              name,
+              m,
+              output->vertices.data[meshlet->vertex_offset + i]);
+      }
+    }
+
+    for (u32 corner = 0; corner < 3 * meshlet->triangle_count; corner++)
+    {
+      u8 local = output->triangles.data[meshlet->triangle_offset + corner];
+      check(local < meshlet->vertex_count,
+            "%s meshlet %u corner %u uses slot %u of %u",
+            name,
+            m,
+            corner,
+            local,
+            meshlet->vertex_count);
+      check(MeshletIndex(output, meshlet, corner) == mesh->indices[index],
+            "%s meshlet %u corner %u is vertex %u, the index list has %u",
+            name,
+            m,
+            corner,
+            MeshletIndex(output, meshlet, corner),
+            mesh->indices[index]);
+      index++;
+    }
+
+    if (m + 1 < output->meshlets.count)
+    {
+      u32 new_vertices = 0;
+      for (u32 k = 0; k < 3; k++)
+      {
+        u32 vertex = mesh->indices[index + k];
+        bool seen = false;
+        for (u32 i = 0; i < meshlet->vertex_count; i++)
+        {
+          seen |= output->vertices.data[meshlet->vertex_offset + i] == vertex;
+        }
+        for (u32 j = 0; j < k; j++)
+        {
+          seen |= mesh->indices[index + j] == vertex;
+        }
+        new_vertices += !seen;
+      }
+      check(meshlet->vertex_count + new_vertices > MESHLET_MAX_VERTICES ||
+              meshlet->triangle_count == MESHLET_MAX_TRIANGLES,
+            "%s meshlet %u was closed early at %u vertices %u triangles",
+            name,
+            m,
+            meshlet->vertex_count,
+            meshlet->triangle_count);
+    }
+  }
+  check(index == mesh->indices.size(),
+        "%s meshlets cover %u of %zu indices",
+        name,
+        index,
+        mesh->indices.size());
+}
+
+static void CheckSpheres(const char *name,
+                         TestMesh *mesh,
+                         const MeshletOutput *output)
+{
+  for (u32 m = 0; m < output->meshlets.count; m++)
+  {
+    const Meshlet *meshlet = &output->meshlets.data[m];
+    float slack = meshlet->radius * 1e-5f + 1e-6f;
+    for (u32 i = 0; i < meshlet->vertex_count; i++)
+    {
+      const Vertex *vertex =
+        &mesh->vertices[output->vertices.data[meshlet->vertex_offset + i]];
+      HMM_Vec3 p = HMM_V3(vertex->x, vertex->y, vertex->z);
+      float distance = HMM_LenV3(HMM_SubV3(p, meshlet->center));
+      check(distance <= meshlet->radius + slack,
+            "%s meshlet %u vertex %u is %g from the center, radius %g",
+            name,
+            m,
+            i,
+            distance,
+            meshlet->radius);
+    }
+  }
+}
+
+// samples cameras inside the culling region, every triangle of the meshlet
+// has to face away from each of them. returns how many meshlets can cull
+static u32 CheckCones(const char *name,
+                      TestMesh *mesh,
+                      const MeshletOutput *output)
+{
+  u64 rng = 0x2545f4914f6cdd1dull;
+  float distances[] = { 0.0f, 0.01f, 1.0f, 10.0f, 1000.0f };
+  u32 culling = 0;
+  for (u32 m = 0; m < output->meshlets.count; m++)
+  {
+    const Meshlet *meshlet = &output->meshlets.data[m];
+    if (meshlet->cone_cutoff >= 1.0f)
+    {
+      continue;
+    }
+    culling++;
+    HMM_Vec3 axis = meshlet->cone_axis;
+    check(fabsf(HMM_LenV3(axis) - 1.0f) < 1e-4f,
+          "%s meshlet %u cone axis is not unit length",
+          name,
+          m);
+
+    // any two directions perpendicular to the axis
+    HMM_Vec3 helper =
+      fabsf(axis.X) < 0.9f ? HMM_V3(1.0f, 0.0f, 0.0f) : HMM_V3(0, 1.0f, 0);
+    HMM_Vec3 tangent = HMM_NormV3(HMM_Cross(axis, helper));
+    HMM_Vec3 bitangent = HMM_Cross(axis, tangent);
+
+    for (u32 sample = 0; sample < 64; sample++)
+    {
+      // the boundary itself is part of the culling region
+      float cosine = sample < 8 ? meshlet->cone_cutoff
+                                : meshlet->cone_cutoff +
+                                    (1.0f - meshlet->cone_cutoff) *
+                                      RandomUnit(&rng);
+      float sine = sqrtf(fmaxf(0.0f, 1.0f - cosine * cosine));
+      float angle = 2.0f * HMM_PI32 * RandomUnit(&rng);
+      HMM_Vec3 direction = HMM_AddV3(
+        HMM_MulV3F(axis, cosine),
+        HMM_AddV3(HMM_MulV3F(tangent, sine * cosf(angle)),
+                  HMM_MulV3F(bitangent, sine * sinf(angle))));
+      float distance = distances[sample % 5];
+      HMM_Vec3 camera =
+        HMM_SubV3(meshlet->cone_apex, HMM_MulV3F(direction, distance));
+
+      for (u32 t = 0; t < meshlet->triangle_count; t++)
+      {
+        HMM_Vec3 p[3];
+        for (u32 k = 0; k < 3; k++)
+        {
+          const Vertex *vertex =
+            &mesh->vertices[MeshletIndex(output, meshlet, 3 * t + k)];
+          p[k] = HMM_V3(vertex->x, vertex->y, vertex->z);
+        }
+        HMM_Vec3 normal =
+          HMM_Cross(HMM_SubV3(p[1], p[0]), HMM_SubV3(p[2], p[0]));
+        float length = HMM_LenV3(normal);
+        if (length <= 0.0f)
+        {
+          continue;
+        }
+        normal = HMM_DivV3F(normal, length);
+        // front facing when the camera is on the normal's side of the plane
+        float side = HMM_DotV3(HMM_SubV3(camera, p[0]), normal);
+        float slack = 1e-4f * (1.0f + distance + meshlet->radius);
+        check(side <= slack,
+              "%s meshlet %u triangle %u faces a camera %g along the cone, "
+              "side %g",
+              name,
+              m,
+              t,
+              distance,
+              side);
+      }
+    }
+  }
+  return culling;
+}
+
+static void TestGeneratedMesh(Arena *arena, const char *name, TestMesh mesh)
+{
+  ArenaTemp temp = ArenaTempBegin(arena);
+  MeshletOutput output = Build(arena, &mesh);
+  CheckTopology(name, &mesh, &output);
+  CheckSpheres(name, &mesh, &output);
+  u32 culling = CheckCones(name, &mesh, &output);
+  check(culling > 0, "%s has no meshlet with a usable cone", name);
+  printf("%s: %u meshlets, %u with cones\n",
+         name,
+         output.meshlets.count,
+         culling);
+  ArenaTempEnd(temp);
+}
+
+// a vertex used on both sides of a meshlet boundary gets a fresh slot in the
+// second meshlet instead of the stale one from the first
+static void TestSlotReuse(Arena *arena)
+{
+  ArenaTemp temp = ArenaTempBegin(arena);
+  TestMesh mesh;
+  for (u32 i = 0; i < 43; i++)
+  {
+    Vertex vertex = {};
+    vertex.x = (float)i;
+    vertex.y = (float)(i % 3);
+    mesh.vertices.push_back(vertex);
+  }
+  // the first meshlet fills its triangle cap reusing vertex 0 throughout,
+  // the second starts on a triangle that uses vertex 0 in a new position
+  for (u32 t = 0; t < MESHLET_MAX_TRIANGLES + 2; t++)
+  {
+    u32 a = t % 20 + 1;
+    u32 triangle[3] = { 0, a, a + 20 };
+    if (t == MESHLET_MAX_TRIANGLES)
+    {
+      triangle[0] = 41;
+      triangle[1] = 42;
+      triangle[2] = 0;
+    }
+    mesh.indices.insert(mesh.indices.end(), triangle, triangle + 3);
+  }
+
+  MeshletOutput output = Build(arena, &mesh);
+  check(output.meshlets.count == 2,
+        "triangle cap split into %u meshlets",
+        output.meshlets.count);
+  const Meshlet *first = &output.meshlets.data[0];
+  const Meshlet *second = &output.meshlets.data[1];
+  check(first->triangle_count == MESHLET_MAX_TRIANGLES,
+        "first meshlet has %u triangles",
+        first->triangle_count);
+  check(first->vertex_count == 41,
+        "first meshlet has %u vertices",
+        first->vertex_count);
+  check(second->vertex_count == 5 &&
+          output.vertices.data[second->vertex_offset + 2] == 0,
+        "vertex 0 did not get a fresh slot in the second meshlet");
+  CheckTopology("slot reuse", &mesh, &output);
+  ArenaTempEnd(temp);
+}
+
+int main()
+{
+  Arena arena = ArenaReserve((u64)256 * 1024 * 1024, ARENA_FLAG_VIRTUAL);
+
+  TestSlotReuse(&arena);
+  TestGeneratedMesh(&arena, "grid", GridMesh(61));
+  TestGeneratedMesh(&arena, "sphere", SphereMesh(40, 80, 3.0f));
+  // far from the origin, the cone apex is pulled well outside the sphere
+  TestMesh sphere = SphereMesh(12, 24, 0.01f);
+  for (Vertex &vertex : sphere.vertices)
+  {
+    vertex.x += 500.0f;
+  }
+  TestGeneratedMesh(&arena, "small offset sphere", sphere);
+
+  ArenaRelease(&arena);
+  ReleaseThreadScratch();
+  printf("meshlet: ok\n");
+  return 0;
+}
@@ -0,0 +1,182 @@
+#include "../src/arena.cpp"
+#include "../src/pool.h"
+#include <algorithm>
+#include <vector>
+
+// pool allocator checks, exits non zero on the first failure
+//     pool_test
+//
+#define check(cond, ...)                                                       \
+  do                                                                           \
+  {                                                                            \
+    if (!(cond))                                                               \
+    {                                                                          \
+      fprintf(stderr, "[FAIL] %s:%d: ", __FILE__, __LINE__);                   \
+      fprintf(stderr, __VA_ARGS__);                                            \
+      fprintf(stderr, "\n");                                                   \
+      exit(1);                                                                 \
+    }                                                                          \
+  } while (0)
+
+struct Record
+{
+  u64 id;
+  float values[5];
+};
+
+struct alignas(32) WideRecord
+{
+  float lanes[8];
+  u32 id;
+};
+
+// smaller than the free list link, the slot has to be padded up to it
+struct TinyRecord
+{
+  u8 value;
+};
+
+// freed items come back before the pool grows, most recent first, zeroed
+static void TestReuse()
+{
+  Arena arena = ArenaReserve((u64)1024 * 1024, ARENA_FLAG_VIRTUAL);
+  Pool<Record> pool = PoolInit<Record>(&arena, 16);
+
+  Record *items[16];
+  for (u32 i = 0; i < 16; i++)
+  {
+    items[i] = PoolAlloc(&pool);
+    items[i]->id = i + 1;
+  }
+  check(pool.live_count == 16 && pool.capacity == 16,
+        "live %u capacity %u after filling one slab",
+        pool.live_count,
+        pool.capacity);
+
+  PoolFree(&pool, items[3]);
+  PoolFree(&pool, items[9]);
+  PoolFree(&pool, (Record *)NULL);
+  check(pool.live_count == 14, "live %u after two frees", pool.live_count);
+
+  Record *first = PoolAlloc(&pool);
+  Record *second = PoolAlloc(&pool);
+  check(first == items[9] && second == items[3],
+        "freed slots were not handed back most recent first");
+  check(first->id == 0 && second->id == 0, "reused slot was not zeroed");
+  check(pool.capacity == 16, "pool grew with free slots left");
+
+  // with one slot free, churn keeps recycling it instead of pushing a slab
+  PoolFree(&pool, first);
+  u64 used = arena.offset;
+  for (u32 round = 0; round < 1000; round++)
+  {
+    Record *record = PoolAlloc(&pool);
+    PoolFree(&pool, record);
+  }
+  check(arena.offset == used, "alloc and free churn pushed onto the arena");
+
+  ArenaRelease(&arena);
+}
+
+// every slab starts on a cache line and every item keeps its alignment, even
+// when the arena is left misaligned in between
+template <typename T>
+static void TestAlignment(const char *name)
+{
+  Arena arena = ArenaReserve((u64)1024 * 1024, ARENA_FLAG_VIRTUAL);
+  Pool<T> pool = PoolInit<T>(&arena, 5);
+
+  std::vector<T *> items;
+  for (u32 i = 0; i < 23; i++)
+  {
+    ArenaPushNoZero(&arena, 1 + i % 7);
+    items.push_back(PoolAlloc(&pool));
+  }
+  for (u32 i = 0; i < items.size(); i++)
+  {
+    u64 address = (u64)items[i];
+    check(address % alignof(T) == 0,
+          "%s item %u misaligned at %p",
+          name,
+          i,
+          (void *)items[i]);
+    // the slab's first item sits at the slab start
+    if (i % pool.slab_items == 0)
+    {
+      check(address % CACHE_LINE_SIZE == 0,
+            "%s slab %u does not start on a cache line",
+            name,
+            i / pool.slab_items);
+    }
+  }
+
+  ArenaRelease(&arena);
+}
+
+// running out pushes a whole new slab, items from every slab stay disjoint
+static void TestGrowth()
+{
+  Arena arena = ArenaReserve((u64)8 * 1024 * 1024, ARENA_FLAG_VIRTUAL);
+  Pool<Record> pool = PoolInit<Record>(&arena, 8);
+  check(pool.capacity == 0 && pool.free_list == NULL,
+        "init already pushed a slab");
+
+  std::vector<Record *> items;
+  for (u32 i = 0; i < 8; i++)
+  {
+    items.push_back(PoolAlloc(&pool));
+  }
+  check(pool.capacity == 8, "capacity %u after one slab", pool.capacity);
+  items.push_back(PoolAlloc(&pool));
+  check(pool.capacity == 16, "capacity %u after growing", pool.capacity);
+
+  for (u32 i = 9; i < 1000; i++)
+  {
+    items.push_back(PoolAlloc(&pool));
+  }
+  check(pool.capacity == 1000, "capacity %u for 1000 items", pool.capacity);
+  for (u32 i = 0; i < items.size(); i++)
+  {
+    items[i]->id = i;
+  }
+
+  std::vector<Record *> sorted = items;
+  std::sort(sorted.begin(), sorted.end());
+  for (u32 i = 1; i < sorted.size(); i++)
+  {
+    check((u8 *)sorted[i - 1] + sizeof(Record) <= (u8 *)sorted[i],
+          "items at %p and %p overlap",
+          (void *)sorted[i - 1],
+          (void *)sorted[i]);
+  }
+  for (u32 i = 0; i < items.size(); i++)
+  {
+    check(items[i]->id == i, "item %u was overwritten", i);
+  }
+
+  // emptying and refilling the pool stays within the slabs it has
+  for (Record *record : items)
+  {
+    PoolFree(&pool, record);
+  }
+  check(pool.live_count == 0, "live %u after freeing all", pool.live_count);
+  for (u32 i = 0; i < 1000; i++)
+  {
+    PoolAlloc(&pool);
+  }
+  check(pool.capacity == 1000, "refill grew the pool to %u", pool.capacity);
+
+  ArenaRelease(&arena);
+}
+
+int main()
+{
+  TestReuse();
+  TestAlignment<Record>("Record");
+  TestAlignment<WideRecord>("WideRecord");
+  TestAlignment<TinyRecord>("TinyRecord");
+  TestGrowth();
+
+  printf("pool: ok\n");
+  return 0;
+}